@@ -19,11 +19,25 @@
 */
 
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <istream>
 #include <vector>
 
+#include "misc.h"
+#include "movegen.h"
 #include "position.h"
+#include "thread.h"
+#include "tt.h"
+
+#if defined(EVAL_LEARN)
+#include <numeric>
+#include <thread>
+
+#include "evaluate.h"
+#include "uci.h"
+#include "learn/learn.h"
+#endif
 
 using namespace std;
 
@@ -92,6 +106,76 @@ const vector<string> Defaults = {
   "setoption name UCI_Chess960 value false"
 };
 
+// TTStats counts the probes of a table by bench_tt()
+struct TTStats {
+  uint64_t probes, hits, collisions;
+};
+
+// A fingerprint of the key, stored as the value of the entries to detect the
+// collisions. Its bits are used neither for the index nor as the entry key.
+Value key_check(const Key key) { return static_cast<Value>(static_cast<int16_t>(key >> 16)); }
+
+template<typename Layout>
+void tt_walk(Position& pos, const TranspositionTableT<Layout>& tt, const Depth depth, TTStats& stats) {
+
+  bool found;
+  const Key key = pos.key();
+  auto* tte = tt.probe(key, found);
+
+  ++stats.probes;
+  if (found)
+  {
+      ++stats.hits;
+      stats.collisions += tte->value() != key_check(key);
+  }
+  tte->save(key, key_check(key), false, BOUND_EXACT, depth, MOVE_NONE, VALUE_NONE, tt.generation());
+
+  if (depth <= 0)
+      return;
+
+  StateInfo st;
+  for (const auto& m : MoveList<LEGAL>(pos))
+  {
+      pos.do_move(m, st);
+      tt_walk(pos, tt, depth - 1, stats);
+      pos.undo_move(m);
+  }
+}
+
+template<typename Layout>
+void tt_bench_layout(const size_t mbSize, const Depth depth) {
+
+  TranspositionTableT<Layout> tt;
+  tt.resize(mbSize, true);
+
+  TTStats stats = {};
+  Position pos;
+  StateInfo st;
+  bool chess960 = false;
+
+  TimePoint elapsed = now();
+
+  for (const string& fen : Defaults)
+      if (fen.find("setoption") != string::npos)
+          chess960 = fen.find("true") != string::npos;
+      else
+      {
+          pos.set(fen.substr(0, fen.find(" moves")), chess960, &st, Threads.main());
+          tt_walk(pos, tt, depth, stats);
+      }
+
+  elapsed = now() - elapsed + 1;
+
+  cerr << setw(4) << Layout::Bytes << " bytes, "
+       << Layout::ClusterSize << " x " << setw(2) << Layout::Bytes / Layout::ClusterSize
+       << setw(10) << mbSize
+       << setw(12) << mbSize * 1024 * 1024 / Layout::Bytes * Layout::ClusterSize
+       << setw(12) << stats.probes
+       << setw(10) << fixed << setprecision(2) << 100.0 * stats.hits / stats.probes << "%"
+       << setw(14) << 1000000.0 * stats.collisions / stats.probes
+       << setw(10) << elapsed << endl;
+}
+
 } // namespace
 
 /// setup_bench() builds a list of UCI commands to be run by bench. There
@@ -159,3 +243,135 @@ vector<string> setup_bench(const Position& current, istream& is) {
 
   return list;
 }
+
+#if defined(EVAL_LEARN)
+
+/// bench_packed() measures the throughput of the inner loops of learn and
+/// gensfen: evaluate() or qsearch() on positions decoded from a file of
+/// PackedSfenValue records, split among the threads. There are three
+/// parameters: the file name, the maximum number of positions to read (all by
+/// default) and the number of threads.
+///
+/// bench evalbin teacher.bin -> evaluate all the positions of teacher.bin
+/// bench qsearchbin teacher.bin 100000 4 -> qsearch the first 100K positions with 4 threads
+
+void bench_packed(istream& is, const bool qsearch) {
+
+  string token;
+
+  const string fileName = is >> token ? token : "";
+  const uint64_t count  = is >> token ? stoull(token) : UINT64_MAX;
+  const size_t requested = is >> token ? stoul(token) : 1;
+
+  vector<Learner::PackedSfenValue> sfens;
+  ifstream file(fileName, ios::binary);
+
+  if (!file.is_open())
+  {
+      cerr << "Unable to open file " << fileName << endl;
+      return;
+  }
+
+  Learner::PackedSfenValue psv;
+  while (sfens.size() < count && file.read(reinterpret_cast<char*>(&psv), sizeof(psv)))
+      sfens.push_back(psv);
+
+  // Clamped to the range of the Threads option, that ignores other values.
+  // The workers index the pool, so its actual size is used, and the user's
+  // setting is restored at the end.
+  const string oldThreads = Options["Threads"];
+  Options["Threads"] = to_string(Utility::clamp(requested, size_t(1), size_t(512)));
+  const size_t threads = Threads.size();
+  init_nnue();
+  Search::clear();
+
+  // Positions in check are skipped by evalbin, evaluate() does not handle them
+  vector<uint64_t> positions(threads), nodes(threads);
+  vector<int64_t> checksum(threads);
+  vector<thread> workers;
+
+  TimePoint elapsed = now();
+
+  for (size_t t = 0; t < threads; ++t)
+      workers.emplace_back([&, t] {
+
+          WinProcGroup::bindThisThread(t);
+
+          Thread* th = Threads[t];
+          Position pos;
+          StateInfo si;
+
+          for (size_t i = t; i < sfens.size(); i += threads)
+          {
+              if (pos.set_from_packed_sfen(sfens[i].sfen, &si, th) != 0)
+                  continue;
+
+              if (qsearch)
+              {
+                  checksum[t] += Learner::qsearch(pos).first;
+                  nodes[t] += th->nodes;
+              }
+              else if (!pos.checkers())
+                  checksum[t] += Eval::evaluate(pos);
+              else
+                  continue;
+
+              ++positions[t];
+          }
+      });
+
+  for (auto& w : workers)
+      w.join();
+
+  elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+  const uint64_t totalPositions = accumulate(positions.begin(), positions.end(), uint64_t(0));
+  const uint64_t totalNodes = accumulate(nodes.begin(), nodes.end(), uint64_t(0));
+
+  cerr << "\n==========================="
+       << "\nTotal time (ms) : " << elapsed
+       << "\nPositions       : " << totalPositions
+       << "\nPositions/second: " << 1000 * totalPositions / elapsed
+       << "\nValue checksum  : " << accumulate(checksum.begin(), checksum.end(), int64_t(0));
+
+  if (qsearch)
+      cerr << "\nNodes searched  : " << totalNodes
+           << "\nNodes/second    : " << 1000 * totalNodes / elapsed;
+
+  cerr << "\nThreads         : " << threads << endl;
+
+  Options["Threads"] = oldThreads;
+}
+
+#endif // defined(EVAL_LEARN)
+
+
+/// bench_tt() compares the cluster layouts of the transposition table. For
+/// each layout and table size, the nodes of a perft of the default positions
+/// are probed and saved. The hit rate and the collisions, the probes finding
+/// the entry of another position, are reported per million probes.
+///
+/// bench tt -> perft 3, with tables of 1, 4 and 16 MB
+/// bench tt 5 16 256 -> perft 5, with tables of 16 and 256 MB
+
+void bench_tt(istream& is) {
+
+  string token;
+  const Depth depth = is >> token ? static_cast<Depth>(stoi(token)) : 3;
+  vector<size_t> sizes;
+
+  while (is >> token)
+      sizes.push_back(stoul(token));
+
+  if (sizes.empty())
+      sizes = { 1, 4, 16 };
+
+  cerr << "\nCluster layout     Size (MB)   Entries      Probes    Hit rate   Collisions/M   Time (ms)" << endl;
+
+  for (const size_t mbSize : sizes)
+  {
+      tt_bench_layout<TTLayout16>(mbSize, depth);
+      tt_bench_layout<TTLayout32>(mbSize, depth);
+      tt_bench_layout<TTLayout64>(mbSize, depth);
+  }
+}
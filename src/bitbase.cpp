@@ -18,11 +18,12 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cassert>
 #include <vector>
-#include <bitset>
 
 #include "bitboard.h"
+#include "tables.h"
 #include "types.h"
 
 namespace {
@@ -31,7 +32,7 @@ namespace {
   // Positions with the pawn on files E to H will be mirrored before probing.
   constexpr unsigned MAX_INDEX = 2*24*64*64; // stm * psq * wksq * bksq = 196608
 
-  std::bitset<MAX_INDEX> KPKBitbase;
+  static_assert(MAX_INDEX == Tables::KPKIndexCount, "KPK bitbase size mismatch");
 
   // A KPK bitbase index is an integer in [0, IndexMax] range
   //
@@ -73,11 +74,16 @@ bool Bitbases::probe(const Square wksq, const Square wpsq, const Square bksq, co
 
   assert(file_of(wpsq) <= FILE_D);
 
-  return KPKBitbase[index(stm, bksq, wksq, wpsq)];
+  const unsigned idx = index(stm, bksq, wksq, wpsq);
+  return Tables::KPKBitbase[idx / 64] >> (idx % 64) & 1;
 }
 
 
-void Bitbases::init() {
+/// Bitbases::generate() computes the KPK bitbase by retrograde analysis and
+/// stores it in bits[], in the layout of Tables::KPKBitbase. It is used only
+/// to generate and check tables.cpp, the engine probes the precomputed table.
+
+void Bitbases::generate(uint64_t bits[]) {
 
   std::vector<KPKPosition> db(MAX_INDEX);
   unsigned idx, repeat = 1;
@@ -93,9 +99,10 @@ void Bitbases::init() {
           repeat |= db[idx] == UNKNOWN && db[idx].classify(db) != UNKNOWN;
 
   // Fill the bitbase with the decisive results
+  std::fill_n(bits, MAX_INDEX / 64, 0);
   for (idx = 0; idx < MAX_INDEX; ++idx)
       if (db[idx] == WIN)
-          KPKBitbase.set(idx);
+          bits[idx / 64] |= 1ULL << (idx % 64);
 }
 
 
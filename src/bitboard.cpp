@@ -20,9 +20,12 @@
 
 #include <algorithm>
 #include <bitset>
+#include <cassert>
+#include <vector>
 
 #include "bitboard.h"
 #include "misc.h"
+#include "tables.h"
 
 uint8_t PopCnt16[1 << 16];
 uint8_t SquareDistance[SQUARE_NB][SQUARE_NB];
@@ -40,7 +43,7 @@ namespace {
   Bitboard RookTable[0x19000];  // To store rook attacks
   Bitboard BishopTable[0x1480]; // To store bishop attacks
 
-  void init_magics(PieceType pt, Bitboard table[], Magic magics[]);
+  void init_magics(PieceType pt, Bitboard table[], Magic magics[], const Bitboard knownMagics[]);
 }
 
 
@@ -80,8 +83,9 @@ void Bitboards::init() {
       for (Square s2 = SQ_A1; s2 <= SQ_H8; ++s2)
           SquareDistance[s1][s2] = std::max(distance<File>(s1, s2), distance<Rank>(s1, s2));
 
-  init_magics(ROOK, RookTable, RookMagics);
-  init_magics(BISHOP, BishopTable, BishopMagics);
+  // The precomputed magics are for the 64 bit index, 32 bit builds search theirs
+  init_magics(ROOK, RookTable, RookMagics, Is64Bit ? Tables::RookMagics : nullptr);
+  init_magics(BISHOP, BishopTable, BishopMagics, Is64Bit ? Tables::BishopMagics : nullptr);
 
   for (Square s1 = SQ_A1; s1 <= SQ_H8; ++s1)
   {
@@ -105,6 +109,24 @@ void Bitboards::init() {
 }
 
 
+/// Bitboards::find_magics() searches the magic numbers of the 64 bit index for
+/// the sliding piece pt, even in a build using pext. It is used only to
+/// generate and check tables.cpp.
+
+void Bitboards::find_magics(const PieceType pt, Bitboard magics[]) {
+
+  assert(Is64Bit);
+
+  std::vector<Bitboard> table(pt == ROOK ? 0x19000 : 0x1480);
+  Magic m[SQUARE_NB];
+
+  init_magics(pt, table.data(), m, nullptr);
+
+  for (Square s = SQ_A1; s <= SQ_H8; ++s)
+      magics[s] = m[s].magic;
+}
+
+
 namespace {
 
   Bitboard sliding_attack(const PieceType pt, const Square sq, const Bitboard occupied) {
@@ -127,9 +149,10 @@ namespace {
   // init_magics() computes all rook and bishop attacks at startup. Magic
   // bitboards are used to look up attacks of sliding pieces. As a reference see
   // www.chessprogramming.org/Magic_Bitboards. In particular, here we use the so
-  // called "fancy" approach.
+  // called "fancy" approach. The magic numbers are taken from knownMagics[],
+  // or searched when it is null.
 
-  void init_magics(const PieceType pt, Bitboard table[], Magic magics[]) {
+  void init_magics(const PieceType pt, Bitboard table[], Magic magics[], const Bitboard knownMagics[]) {
 
     // Optimal PRNG seeds to pick the correct magics in the shortest time
     int seeds[][RANK_NB] = { { 8977, 44560, 54343, 38998,  5731, 95205, 104912, 17020 },
@@ -155,6 +178,7 @@ namespace {
         // Set the offset for the attacks table of the square. We have individual
         // table sizes for each square with "Fancy Magic Bitboards".
         m.attacks = s == SQ_A1 ? table : magics[s - 1].attacks + size;
+        m.magic = knownMagics ? knownMagics[s] : 0;
 
         // Use Carry-Rippler trick to enumerate all subsets of masks[s] and
         // store the corresponding sliding attack bitboard in reference[].
@@ -163,14 +187,14 @@ namespace {
             occupancy[size] = b;
             reference[size] = sliding_attack(pt, s, b);
 
-            if (HasPext)
-                m.attacks[pext(b, m.mask)] = reference[size];
+            if (knownMagics)
+                m.attacks[m.index(b)] = reference[size];
 
             size++;
             b = b - m.mask & m.mask;
         } while (b);
 
-        if (HasPext)
+        if (knownMagics)
             continue;
 
         PRNG rng(seeds[Is64Bit][rank_of(s)]);
@@ -190,7 +214,7 @@ namespace {
             // m.attacks[] after every failed attempt.
             for (++cnt, i = 0; i < size; ++i)
             {
-	            if (unsigned idx = m.index(occupancy[i]); epoch[idx] < cnt)
+	            if (unsigned idx = m.magic_index(occupancy[i]); epoch[idx] < cnt)
                 {
                     epoch[idx] = cnt;
                     m.attacks[idx] = reference[i];
@@ -27,14 +27,15 @@
 
 namespace Bitbases {
 
-void init();
 bool probe(Square wksq, Square wpsq, Square bksq, Color stm);
+void generate(uint64_t bits[]);
 
 }
 
 namespace Bitboards {
 
 void init();
+void find_magics(PieceType pt, Bitboard magics[]);
 std::string pretty(Bitboard b);
 
 }
@@ -93,6 +94,12 @@ struct Magic {
     if (HasPext)
         return static_cast<unsigned>(pext(occupied, mask));
 
+    return magic_index(occupied);
+  }
+
+  // The index with the magic number, also used to find the magics with pext
+  [[nodiscard]] unsigned magic_index(const Bitboard occupied) const {
+
     if (Is64Bit)
         return static_cast<unsigned>((occupied & mask) * magic >> shift);
 
@@ -9,31 +9,39 @@
 #include "../layers/input_slice.h"
 #include "../layers/affine_transform.h"
 #include "../layers/clipped_relu.h"
+#include "../layers/affine_transform_clipped.h"
 
 namespace Eval {
 
 namespace NNUE {
 
-// Input features used in evaluation function
-using RawFeatures = Features::FeatureSet<
-    Features::HalfKP<Features::Side::kFriend>>;
+namespace Architectures {
 
-// Number of input feature dimensions after conversion
-constexpr IndexType kTransformedFeatureDimensions = 384;
+struct HalfKP_384x2_32_32 {
 
-namespace Layers {
+  // Name of the architecture, as the file name of this header
+  static constexpr const char* kName = "halfkp_384x2-32-32";
 
-// define network structure
-using InputLayer = InputSlice<kTransformedFeatureDimensions * 2>;
-using HiddenLayer1 = ClippedReLU<AffineTransform<InputLayer, 32>>;
-using HiddenLayer2 = ClippedReLU<AffineTransform<HiddenLayer1, 32>>;
-using OutputLayer = AffineTransform<HiddenLayer2, 1>;
+  // Input features used in evaluation function
+  using RawFeatures = Features::FeatureSet<
+      Features::HalfKP<Features::Side::kFriend>>;
 
-}  // namespace Layers
+  // Number of input feature dimensions after conversion
+  static constexpr IndexType kTransformedFeatureDimensions = 384;
 
-using Network = Layers::OutputLayer;
+  // define network structure
+  using InputLayer = Layers::InputSlice<kTransformedFeatureDimensions * 2>;
+  using HiddenLayer1 = Layers::ClippedReLU<Layers::AffineTransform<InputLayer, 32>>;
+  using HiddenLayer2 = Layers::ClippedReLU<Layers::AffineTransform<HiddenLayer1, 32>>;
+  using OutputLayer = Layers::AffineTransform<HiddenLayer2, 1>;
+
+  using Network = OutputLayer;
+};
+
+}  // namespace Architectures
 
 }  // namespace NNUE
 
 }  // namespace Eval
+
 #endif // HALFKP_384X2_32_32_H
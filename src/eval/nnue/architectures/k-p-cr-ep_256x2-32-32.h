@@ -12,31 +12,39 @@
 #include "../layers/input_slice.h"
 #include "../layers/affine_transform.h"
 #include "../layers/clipped_relu.h"
+#include "../layers/affine_transform_clipped.h"
 
 namespace Eval {
 
-  namespace NNUE {
+namespace NNUE {
 
-    // Input features used in evaluation function
-    using RawFeatures = Features::FeatureSet<Features::K, Features::P,
-      Features::CastlingRight, Features::EnPassant>;
+namespace Architectures {
+
+struct K_P_CR_EP_256x2_32_32 {
 
-    // Number of input feature dimensions after conversion
-    constexpr IndexType kTransformedFeatureDimensions = 256;
+  // Name of the architecture, as the file name of this header
+  static constexpr const char* kName = "k-p-cr-ep_256x2-32-32";
 
-    namespace Layers {
+  // Input features used in evaluation function
+  using RawFeatures = Features::FeatureSet<Features::K, Features::P,
+      Features::CastlingRight, Features::EnPassant>;
 
-      // define network structure
-      using InputLayer = InputSlice<kTransformedFeatureDimensions * 2>;
-      using HiddenLayer1 = ClippedReLU<AffineTransform<InputLayer, 32>>;
-      using HiddenLayer2 = ClippedReLU<AffineTransform<HiddenLayer1, 32>>;
-      using OutputLayer = AffineTransform<HiddenLayer2, 1>;
+  // Number of input feature dimensions after conversion
+  static constexpr IndexType kTransformedFeatureDimensions = 256;
 
-    }  // namespace Layers
+  // define network structure
+  using InputLayer = Layers::InputSlice<kTransformedFeatureDimensions * 2>;
+  using HiddenLayer1 = Layers::ClippedReLU<Layers::AffineTransform<InputLayer, 32>>;
+  using HiddenLayer2 = Layers::ClippedReLU<Layers::AffineTransform<HiddenLayer1, 32>>;
+  using OutputLayer = Layers::AffineTransform<HiddenLayer2, 1>;
 
-    using Network = Layers::OutputLayer;
+  using Network = OutputLayer;
+};
 
-  }  // namespace NNUE
+}  // namespace Architectures
+
+}  // namespace NNUE
 
 }  // namespace Eval
+
 #endif // K_P_CR_EP_256X2_32_32_H
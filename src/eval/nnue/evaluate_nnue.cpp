@@ -2,12 +2,15 @@
 
 #if defined(EVAL_NNUE)
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <vector>
 
 #include "../../evaluate.h"
 #include "../../position.h"
 #include "../../misc.h"
+#include "../../thread.h"
 #include "../../uci.h"
 
 #include "evaluate_nnue.h"
@@ -16,11 +19,8 @@ namespace Eval {
 
 namespace NNUE {
 
-// Input feature converter
-AlignedPtr<FeatureTransformer> feature_transformer;
-
-// Evaluation function
-AlignedPtr<Network> network;
+// Evaluator of the loaded network
+std::unique_ptr<Evaluator> evaluator;
 
 // Evaluation function file name
 std::string fileName = "nn.bin";
@@ -28,11 +28,8 @@ std::string fileName = "nn.bin";
 // Saved evaluation function file name
 std::string savedfileName = "nn.bin";
 
-// Get a string that represents the structure of the evaluation function
-std::string GetArchitectureString() {
-  return "Features=" + FeatureTransformer::GetStructureString() +
-      ",Network=" + Network::GetStructureString();
-}
+// Hash of the loaded parameters, 0 when no network is loaded
+std::uint64_t parametersHash = 0;
 
 namespace {
 
@@ -40,8 +37,13 @@ namespace Detail {
 
 // Initialize the evaluation function parameters
 template <typename T>
-void Initialize(AlignedPtr<T>& pointer) {
-  pointer.reset(static_cast<T*>(aligned_malloc(sizeof(T), alignof(T))));
+void Initialize(AlignedPtr<T>& pointer, PageKind& kind) {
+  void* const mem = aligned_large_pages_alloc(sizeof(T), &kind);
+  if (!mem) {
+    std::cout << "info string can't allocate memory. size = " << sizeof(T) << std::endl;
+    exit(1);
+  }
+  pointer.reset(static_cast<T*>(mem));
   std::memset(pointer.get(), 0, sizeof(T));
 }
 
@@ -54,6 +56,15 @@ bool ReadParameters(std::istream& stream, const AlignedPtr<T>& pointer) {
   return pointer->ReadParameters(stream);
 }
 
+// FNV-1a hash of the parameters, used to identify the loaded network
+template <typename T>
+std::uint64_t HashParameters(const AlignedPtr<T>& pointer, std::uint64_t hash) {
+  const auto bytes = reinterpret_cast<const unsigned char*>(pointer.get());
+  for (std::size_t i = 0; i < sizeof(T); ++i)
+    hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+  return hash;
+}
+
 // write evaluation function parameters
 template <typename T>
 bool WriteParameters(std::ostream& stream, const AlignedPtr<T>& pointer) {
@@ -64,64 +75,53 @@ bool WriteParameters(std::ostream& stream, const AlignedPtr<T>& pointer) {
 
 }  // namespace Detail
 
-// Initialize the evaluation function parameters
-void Initialize() {
-  Detail::Initialize(feature_transformer);
-  Detail::Initialize(network);
-}
-
-}  // namespace
+// Entry of the registry of the architectures built in
+struct ArchitectureEntry {
+  std::uint32_t version;
+  std::uint32_t hash_value;
+  const char* name;
+  std::string (*architecture)();
+  std::unique_ptr<Evaluator> (*create)();
+};
 
-// read the header
-bool ReadHeader(std::istream& stream,
-  std::uint32_t* hash_value, std::string* architecture) {
-  std::uint32_t version, size;
-  stream.read(reinterpret_cast<char*>(&version), sizeof version);
-  stream.read(reinterpret_cast<char*>(hash_value), sizeof*hash_value);
-  stream.read(reinterpret_cast<char*>(&size), sizeof size);
-  if (!stream || version != kVersion) return false;
-  architecture->resize(size);
-  stream.read(&(*architecture)[0], size);
-  return !stream.fail();
+template <typename... ArchitectureTypes>
+std::vector<ArchitectureEntry> MakeRegistry(ArchitectureList<ArchitectureTypes...>) {
+
+  // Files are recognized by their hash value only
+  constexpr std::uint32_t hash_values[] = { BasicEvaluator<ArchitectureTypes>::kHashValue... };
+  static_assert([&] {
+    for (std::size_t i = 0; i < sizeof...(ArchitectureTypes); ++i)
+      for (std::size_t j = 0; j < i; ++j)
+        if (hash_values[i] == hash_values[j]) return false;
+    return true;
+  }(), "Architectures with the same hash value");
+
+  return { { BasicEvaluator<ArchitectureTypes>::FeatureTransformer::kFileVersion,
+             BasicEvaluator<ArchitectureTypes>::kHashValue, ArchitectureTypes::kName,
+             BasicEvaluator<ArchitectureTypes>::ArchitectureString,
+             [] { return std::unique_ptr<Evaluator>(new BasicEvaluator<ArchitectureTypes>()); } }... };
 }
 
-// write the header
-bool WriteHeader(std::ostream& stream,
-                 const std::uint32_t hash_value, const std::string& architecture) {
-  stream.write(reinterpret_cast<const char*>(&kVersion), sizeof kVersion);
-  stream.write(reinterpret_cast<const char*>(&hash_value), sizeof hash_value);
-  const auto size = static_cast<std::uint32_t>(architecture.size());
-  stream.write(reinterpret_cast<const char*>(&size), sizeof size);
-  stream.write(architecture.data(), size);
-  return !stream.fail();
-}
+const std::vector<ArchitectureEntry> Registry = MakeRegistry(BuiltinArchitectures());
 
-// read evaluation function parameters
-bool ReadParameters(std::istream& stream) {
-  std::uint32_t hash_value;
-  std::string architecture;
-  if (!ReadHeader(stream, &hash_value, &architecture)) return false;
-  if (hash_value != kHashValue) return false;
-  if (!Detail::ReadParameters(stream, feature_transformer)) return false;
-  if (!Detail::ReadParameters(stream, network)) return false;
-  return stream && stream.peek() == std::ios::traits_type::eof();
-}
+}  // namespace
 
-// write evaluation function parameters
-bool WriteParameters(std::ostream& stream) {
-  if (!WriteHeader(stream, kHashValue, GetArchitectureString())) return false;
-  if (!Detail::WriteParameters(stream, feature_transformer)) return false;
-  if (!Detail::WriteParameters(stream, network)) return false;
-  return !stream.fail();
+template <typename Architecture>
+BasicEvaluator<Architecture>::BasicEvaluator() {
+  PageKind networkKind;
+  Detail::Initialize(feature_transformer, pageKind);
+  Detail::Initialize(network, networkKind);
 }
 
 // proceed if you can calculate the difference
-static void UpdateAccumulatorIfPossible(const Position& pos) {
+template <typename Architecture>
+void BasicEvaluator<Architecture>::UpdateAccumulatorIfPossible(const Position& pos) const {
   feature_transformer->UpdateAccumulatorIfPossible(pos);
 }
 
 // Calculate the evaluation value
-static Value ComputeScore(const Position& pos, const bool refresh = false) {
+template <typename Architecture>
+Value BasicEvaluator<Architecture>::ComputeScore(const Position& pos, const bool refresh) const {
   auto& accumulator = pos.state()->accumulator;
   if (!refresh && accumulator.computed_score) {
     return accumulator.score;
@@ -156,6 +156,107 @@ static Value ComputeScore(const Position& pos, const bool refresh = false) {
   return accumulator.score;
 }
 
+template <typename Architecture>
+bool BasicEvaluator<Architecture>::ReadParameters(std::istream& stream) {
+  return   Detail::ReadParameters(stream, feature_transformer)
+        && Detail::ReadParameters(stream, network);
+}
+
+template <typename Architecture>
+bool BasicEvaluator<Architecture>::WriteParameters(std::ostream& stream) const {
+  return   Detail::WriteParameters(stream, feature_transformer)
+        && Detail::WriteParameters(stream, network);
+}
+
+template <typename Architecture>
+std::uint64_t BasicEvaluator<Architecture>::HashParameters() const {
+  return Detail::HashParameters(network, Detail::HashParameters(feature_transformer, 0xcbf29ce484222325ULL));
+}
+
+template <typename Architecture>
+std::string BasicEvaluator<Architecture>::ArchitectureString() {
+  return "Features=" + FeatureTransformer::GetStructureString() +
+      ",Network=" + Network::GetStructureString();
+}
+
+BasicEvaluator<DefaultArchitecture>* default_evaluator() {
+  return evaluator && evaluator->GetHashValue() == BasicEvaluator<DefaultArchitecture>::kHashValue
+       ? static_cast<BasicEvaluator<DefaultArchitecture>*>(evaluator.get()) : nullptr;
+}
+
+bool FindArchitecture(const std::uint32_t hash_value, std::string* name, std::string* architecture) {
+  for (const auto& entry : Registry)
+    if (entry.hash_value == hash_value) {
+      *name = entry.name;
+      *architecture = entry.architecture();
+      return true;
+    }
+  return false;
+}
+
+// Get a string that represents the structure of the evaluation function
+std::string GetArchitectureString() {
+  return evaluator ? evaluator->GetArchitectureString() : std::string();
+}
+
+// read the header
+bool ReadHeader(std::istream& stream, std::uint32_t* version,
+  std::uint32_t* hash_value, std::string* architecture) {
+  std::uint32_t size;
+  stream.read(reinterpret_cast<char*>(version), sizeof*version);
+  stream.read(reinterpret_cast<char*>(hash_value), sizeof*hash_value);
+  stream.read(reinterpret_cast<char*>(&size), sizeof size);
+  if (!stream || (*version != kVersion && *version != kVersionInt8Weights)) return false;
+  architecture->resize(size);
+  stream.read(&(*architecture)[0], size);
+  return !stream.fail();
+}
+
+// write the header
+bool WriteHeader(std::ostream& stream, const std::uint32_t version,
+                 const std::uint32_t hash_value, const std::string& architecture) {
+  stream.write(reinterpret_cast<const char*>(&version), sizeof version);
+  stream.write(reinterpret_cast<const char*>(&hash_value), sizeof hash_value);
+  const auto size = static_cast<std::uint32_t>(architecture.size());
+  stream.write(reinterpret_cast<const char*>(&size), sizeof size);
+  stream.write(architecture.data(), size);
+  return !stream.fail();
+}
+
+// read evaluation function parameters
+// The evaluator is replaced by one of the architecture of the file, unless the
+// current one already has it: the learner keeps pointers to its parameters.
+bool ReadParameters(std::istream& stream, std::unique_ptr<Evaluator>& target) {
+  std::uint32_t version, hash_value;
+  std::string architecture;
+  if (!ReadHeader(stream, &version, &hash_value, &architecture)) return false;
+  const auto entry = std::find_if(Registry.begin(), Registry.end(), [&](const ArchitectureEntry& e) {
+    return e.version == version && e.hash_value == hash_value;
+  });
+  if (entry == Registry.end()) return false;
+  if (!target || target->GetHashValue() != hash_value) target = entry->create();
+  if (!target->ReadParameters(stream)) return false;
+  return stream && stream.peek() == std::ios::traits_type::eof();
+}
+
+bool ReadParameters(std::istream& stream) {
+  return ReadParameters(stream, evaluator);
+}
+
+// write evaluation function parameters
+bool WriteParameters(std::ostream& stream) {
+  if (!WriteHeader(stream, evaluator->GetFileVersion(), evaluator->GetHashValue(),
+                   evaluator->GetArchitectureString())) return false;
+  if (!evaluator->WriteParameters(stream)) return false;
+  return !stream.fail();
+}
+
+// Evaluator of the thread of the position, or of the loaded network
+static const Evaluator& ThreadEvaluator(const Position& pos) {
+  const Thread* const th = pos.this_thread();
+  return th && th->evaluator ? *th->evaluator : *evaluator;
+}
+
 } // namespace NNUE
 
 // Class used to store evaluation values ​​in HashTable
@@ -195,18 +296,32 @@ struct alignas(16) ScoreKeyValue {
 };
 
 // Simple HashTable implementation.
-// Size is a power of 2.
+// Size is a power of 2. The entries are allocated, possibly on large pages, by allocate().
 template <typename T, size_t Size>
 struct HashTable {
-  HashTable() { clear(); }
+  ~HashTable() { aligned_large_pages_free(entries_); }
   T* operator [] (const Key k) { return entries_ + (static_cast<size_t>(k) & Size - 1); }
   void clear() { memset(entries_, 0, sizeof(T)*Size); }
 
+  // Allocate the entries once. Returns the kind of pages obtained.
+  PageKind allocate() {
+    if (!entries_) {
+      entries_ = static_cast<T*>(aligned_large_pages_alloc(sizeof(T) * Size, &kind_));
+      if (!entries_) {
+        std::cout << "info string can't allocate memory. size = " << sizeof(T) * Size << std::endl;
+        exit(1);
+      }
+      clear();
+    }
+    return kind_;
+  }
+
   // Check that Size is a power of 2
   static_assert((Size & Size - 1) == 0, "");
 
  private:
-  T entries_[Size];
+  T* entries_ = nullptr;
+  PageKind kind_ = NORMAL_PAGES;
 };
 
 //HashTable to save the evaluated ones (following ehash)
@@ -235,8 +350,11 @@ void prefetch_evalhash(const Key key) {
 // This function may be called twice to flag that the evaluation function needs to be reloaded.
 void load_eval() {
 
-  // Must be done!
-  NNUE::Initialize();
+  // Must be done! Start from a zeroed network of the default architecture,
+  // replaced when reading a file of another architecture.
+  NNUE::evaluator = std::make_unique<NNUE::BasicEvaluator<NNUE::DefaultArchitecture>>();
+  NNUE::parametersHash = 0;
+  const PageKind hashKind = g_evalTable.allocate();
 
   if (static_cast<size_t>(Options["SkipLoadingEval"]))
   {
@@ -254,7 +372,15 @@ void load_eval() {
       std::cout << "info string Error! " << NNUE::fileName << " not found or wrong format" << std::endl;
 
   else
-      std::cout << "info string NNUE " << NNUE::fileName << " found & loaded" << std::endl;
+  {
+      NNUE::parametersHash = NNUE::evaluator->HashParameters();
+
+      std::cout << "info string NNUE " << NNUE::fileName << " found & loaded, architecture "
+                << NNUE::evaluator->GetName() << std::endl;
+  }
+
+  std::cout << "info string NNUE weights allocation: " << page_kind_string(NNUE::evaluator->GetPageKind())
+            << ", eval hash allocation: " << page_kind_string(hashKind) << std::endl;
 }
 
 // Initialization
@@ -266,7 +392,7 @@ void init() {
 // Note that the evaluation value seen from the turn side is returned. (Design differs from other evaluation functions in this respect)
 // Since, we will not try to optimize this function.
 Value compute_eval(const Position& pos) {
-  return NNUE::ComputeScore(pos, true);
+  return NNUE::ThreadEvaluator(pos).ComputeScore(pos, true);
 }
 
 // Evaluation function
@@ -281,13 +407,15 @@ Value NNUE::evaluate(const Position& pos) {
   // Skip the query to the eval hash.
   if (!GlobalOptions.use_eval_hash) {
     ASSERT_LV5(pos.state()->materialValue == Eval::material(pos));
-    return NNUE::ComputeScore(pos);
+    return NNUE::ThreadEvaluator(pos).ComputeScore(pos, false);
   }
 #endif
 
-  if (static_cast<size_t>(Options["UseEvalHash"])) {
+  const NNUE::Evaluator& thread_evaluator = NNUE::ThreadEvaluator(pos);
+
+  if (Conf.useEvalHash) {
       // May be in the evaluate hash table.
-      const Key key = pos.key();
+      const Key key = pos.key() ^ thread_evaluator.evalHashSalt;
       ScoreKeyValue entry = *g_evalTable[key];
       ScoreKeyValue::decode();
       if (entry.key == key) {
@@ -295,7 +423,7 @@ Value NNUE::evaluate(const Position& pos) {
         return static_cast<Value>(entry.score);
       }
 
-      const Value score = ComputeScore(pos);
+      const Value score = thread_evaluator.ComputeScore(pos, false);
 
       // Since it was calculated carefully, save it in the evaluate hash table.
       entry.key = key;
@@ -303,14 +431,25 @@ Value NNUE::evaluate(const Position& pos) {
       ScoreKeyValue::encode();
       *g_evalTable[key] = entry;
   }
-  const Value score = ComputeScore(pos);
+  const Value score = thread_evaluator.ComputeScore(pos, false);
   return score;
 }
 
 // proceed if you can calculate the difference
 void evaluate_with_no_return(const Position& pos) {
-  NNUE::UpdateAccumulatorIfPossible(pos);
+  NNUE::ThreadEvaluator(pos).UpdateAccumulatorIfPossible(pos);
+}
+
+#if defined(NNUE_PREFETCH_WEIGHTS)
+// Prefetch the weights read by the difference calculation after the last
+// move. Useless when the accumulator of the previous position is not computed:
+// it is then refreshed.
+void prefetch_nnue_weights(const Position& pos) {
+  if (Conf.evalNNUE && pos.state()->previous->accumulator.computed_accumulation) {
+    NNUE::ThreadEvaluator(pos).PrefetchWeights(pos);
+  }
 }
+#endif  // defined(NNUE_PREFETCH_WEIGHTS)
 
 // display the breakdown of the evaluation value of the current phase
 void print_eval_stat(Position& /*pos*/) {
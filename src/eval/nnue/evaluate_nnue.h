@@ -16,26 +16,107 @@ namespace NNUE {
 
 Value evaluate(const Position& pos);
 
-// hash value of evaluation function structure
-constexpr std::uint32_t kHashValue =
-    FeatureTransformer::GetHashValue() ^ Network::GetHashValue();
-
-// Deleter for automating release of memory area
+// Deleter for automating release of memory area, allocated with aligned_large_pages_alloc()
 template <typename T>
 struct AlignedDeleter {
   void operator()(T* ptr) const {
     ptr->~T();
-    aligned_free(ptr);
+    aligned_large_pages_free(ptr);
   }
 };
 template <typename T>
 using AlignedPtr = std::unique_ptr<T, AlignedDeleter<T>>;
 
-// Input feature converter
-extern AlignedPtr<FeatureTransformer> feature_transformer;
+// Network of one of the architectures built in. The architecture of a file is
+// found when loading it, and the evaluation is dispatched with a single virtual
+// call: the layers of each architecture are instantiated and inlined separately.
+class Evaluator {
+ public:
+  virtual ~Evaluator() = default;
+
+  // Calculate the evaluation value
+  virtual Value ComputeScore(const Position& pos, bool refresh) const = 0;
+
+  // proceed with the difference calculation if possible
+  virtual void UpdateAccumulatorIfPossible(const Position& pos) const = 0;
+
+#if defined(NNUE_PREFETCH_WEIGHTS)
+  // Prefetch the weights that the next difference calculation will read
+  virtual void PrefetchWeights(const Position& pos) const = 0;
+#endif
+
+  // read/write the parameters of the feature transformer and of the network
+  virtual bool ReadParameters(std::istream& stream) = 0;
+  virtual bool WriteParameters(std::ostream& stream) const = 0;
+
+  // FNV-1a hash of the parameters, used to identify the loaded network
+  [[nodiscard]] virtual std::uint64_t HashParameters() const = 0;
+
+  // hash value of evaluation function structure, and version of its files
+  [[nodiscard]] virtual std::uint32_t GetHashValue() const = 0;
+  [[nodiscard]] virtual std::uint32_t GetFileVersion() const = 0;
+
+  // Get a string that represents the structure of the evaluation function
+  [[nodiscard]] virtual std::string GetArchitectureString() const = 0;
+
+  // Name of the architecture, and kind of pages holding the parameters
+  [[nodiscard]] virtual const char* GetName() const = 0;
+  [[nodiscard]] virtual PageKind GetPageKind() const = 0;
+
+  // Xored into the keys of the eval hash, that is shared by all the threads:
+  // networks loaded side by side must not see the scores of each other
+  Key evalHashSalt = 0;
+};
+
+// Evaluator of the given architecture
+template <typename Architecture>
+class BasicEvaluator final : public Evaluator {
+ public:
+  using FeatureTransformer = BasicFeatureTransformer<Architecture>;
+  using Network = typename Architecture::Network;
+
+  // hash value of evaluation function structure
+  static constexpr std::uint32_t kHashValue =
+      FeatureTransformer::GetHashValue() ^ Network::GetHashValue();
 
-// Evaluation function
-extern AlignedPtr<Network> network;
+  BasicEvaluator();
+
+  Value ComputeScore(const Position& pos, bool refresh) const override;
+  void UpdateAccumulatorIfPossible(const Position& pos) const override;
+#if defined(NNUE_PREFETCH_WEIGHTS)
+  void PrefetchWeights(const Position& pos) const override { feature_transformer->PrefetchWeights(pos); }
+#endif
+  bool ReadParameters(std::istream& stream) override;
+  bool WriteParameters(std::ostream& stream) const override;
+  [[nodiscard]] std::uint64_t HashParameters() const override;
+  [[nodiscard]] std::uint32_t GetHashValue() const override { return kHashValue; }
+  [[nodiscard]] std::uint32_t GetFileVersion() const override { return FeatureTransformer::kFileVersion; }
+  [[nodiscard]] std::string GetArchitectureString() const override { return ArchitectureString(); }
+  static std::string ArchitectureString();
+  [[nodiscard]] const char* GetName() const override { return Architecture::kName; }
+  [[nodiscard]] PageKind GetPageKind() const override { return pageKind; }
+
+  // Input feature converter
+  AlignedPtr<FeatureTransformer> feature_transformer;
+
+  // Evaluation function
+  AlignedPtr<Network> network;
+
+ private:
+  PageKind pageKind;
+};
+
+// Evaluator of the loaded network, used by the threads that do not have a
+// network of their own
+extern std::unique_ptr<Evaluator> evaluator;
+
+// Evaluator of the loaded network if it has the default architecture, the one
+// that the learner trains, nullptr otherwise
+BasicEvaluator<DefaultArchitecture>* default_evaluator();
+
+// Find the built-in architecture with the given hash value. Returns false if
+// there is none.
+bool FindArchitecture(std::uint32_t hash_value, std::string* name, std::string* architecture);
 
 // Evaluation function file name
 extern std::string fileName;
@@ -43,20 +124,27 @@ extern std::string fileName;
 // Saved evaluation function file name
 extern std::string savedfileName;
 
+// Hash of the loaded parameters, 0 when no network is loaded
+extern std::uint64_t parametersHash;
+
 // Get a string that represents the structure of the evaluation function
 std::string GetArchitectureString();
 
 // read the header
-bool ReadHeader(std::istream& stream,
+bool ReadHeader(std::istream& stream, std::uint32_t* version,
     std::uint32_t* hash_value, std::string* architecture);
 
 // write the header
-bool WriteHeader(std::ostream& stream,
+bool WriteHeader(std::ostream& stream, std::uint32_t version,
     std::uint32_t hash_value, const std::string& architecture);
 
 // read evaluation function parameters
 bool ReadParameters(std::istream& stream);
 
+// read a network into the given evaluator, that is replaced by one of the
+// architecture of the file if it has another one
+bool ReadParameters(std::istream& stream, std::unique_ptr<Evaluator>& target);
+
 // write evaluation function parameters
 bool WriteParameters(std::ostream& stream);
 
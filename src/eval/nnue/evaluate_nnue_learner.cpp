@@ -69,9 +69,13 @@ void InitializeTraining(const double eta1, const uint64_t eta1_epoch,
   std::cout << "Initializing NN training for "
             << GetArchitectureString() << std::endl;
 
-  assert(feature_transformer);
-  assert(network);
-  trainer = Trainer<Network>::Create(network.get(), feature_transformer.get());
+  const auto e = default_evaluator();
+  if (!e) {
+    std::cout << "Error! : only networks of the architecture " << DefaultArchitecture::kName
+              << " can be trained" << std::endl;
+    my_exit();
+  }
+  trainer = Trainer<Network>::Create(e->network.get(), e->feature_transformer.get());
 
   if (static_cast<size_t>(Options["SkipLoadingEval"])) {
     trainer->Initialize(rng);
@@ -15,7 +15,7 @@ namespace Eval {
       void CastlingRight::AppendActiveIndices(
         const Position& pos, const Color perspective, IndexList* active) {
         // do nothing if array size is small to avoid compiler warning
-        if constexpr (RawFeatures::kMaxActiveDimensions < kMaxActiveDimensions) return;
+        if constexpr (kMaxActiveIndices < kMaxActiveDimensions) return;
 
         const int castling_rights = pos.state()->castlingRights;
         int relative_castling_rights;
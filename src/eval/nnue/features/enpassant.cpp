@@ -15,7 +15,7 @@ namespace Eval {
       void EnPassant::AppendActiveIndices(
         const Position& pos, const Color perspective, IndexList* active) {
         // do nothing if array size is small to avoid compiler warning
-        if constexpr (RawFeatures::kMaxActiveDimensions < kMaxActiveDimensions) return;
+        if constexpr (kMaxActiveIndices < kMaxActiveDimensions) return;
 
         auto epSquare = pos.state()->epSquare;
         if (epSquare == SQ_NONE) {
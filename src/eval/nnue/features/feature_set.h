@@ -173,11 +173,11 @@ class FeatureSet<FirstFeatureType, RemainingFeatureTypes...> :
       const auto start_removed = removed->size();
       const auto start_added = added->size();
       Head::AppendChangedIndices(pos, perspective, removed, added);
-      for (auto i = start_removed; i < removed->size(); ++i) {
-        (*removed)[i] += Tail::kDimensions;
+      for (auto it = removed->begin() + start_removed; it != removed->end(); ++it) {
+        *it += Tail::kDimensions;
       }
-      for (auto i = start_added; i < added->size(); ++i) {
-        (*added)[i] += Tail::kDimensions;
+      for (auto it = added->begin() + start_added; it != added->end(); ++it) {
+        *it += Tail::kDimensions;
       }
     }
   }
@@ -36,7 +36,7 @@ template <Side AssociatedKing>
 void HalfKP<AssociatedKing>::AppendActiveIndices(
     const Position& pos, const Color perspective, IndexList* active) {
   // do nothing if array size is small to avoid compiler warning
-  if constexpr (RawFeatures::kMaxActiveDimensions < kMaxActiveDimensions) return;
+  if constexpr (kMaxActiveIndices < kMaxActiveDimensions) return;
 
   BonaPiece* pieces;
   Square sq_target_k;
@@ -41,7 +41,7 @@ class ValueList {
 
 //Type of feature index list
 class IndexList
-    : public ValueList<IndexType, RawFeatures::kMaxActiveDimensions> {
+    : public ValueList<IndexType, kMaxActiveIndices> {
 };
 
 }  // namespace Features
@@ -15,7 +15,7 @@ namespace Features {
 void K::AppendActiveIndices(
     const Position& pos, const Color perspective, IndexList* active) {
   // do nothing if array size is small to avoid compiler warning
-  if constexpr (RawFeatures::kMaxActiveDimensions < kMaxActiveDimensions) return;
+  if constexpr (kMaxActiveIndices < kMaxActiveDimensions) return;
 
   const BonaPiece* pieces = perspective == BLACK ?
       pos.eval_list()->piece_list_fb() :
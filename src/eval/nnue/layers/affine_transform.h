@@ -54,6 +54,11 @@ class AffineTransform {
         PreviousLayer::GetStructureString() + ")";
   }
 
+  // Position in weights_ of the weight of input j for output i
+  static constexpr IndexType GetWeightIndex(const IndexType i, const IndexType j) {
+    return i * kPaddedInputDimensions + j;
+  }
+
   // read parameters
   bool ReadParameters(std::istream& stream) {
     if (!previous_layer_.ReadParameters(stream)) return false;
@@ -0,0 +1,260 @@
+﻿// Specialization of layer AffineTransform of NNUE evaluation function for the
+// layers whose input is a ClippedReLU: the small tail of the network.
+
+#ifndef _NNUE_LAYERS_AFFINE_TRANSFORM_CLIPPED_H_
+#define _NNUE_LAYERS_AFFINE_TRANSFORM_CLIPPED_H_
+
+#if defined(EVAL_NNUE) && defined(USE_SSSE3)
+
+#include "../nnue_common.h"
+#include "affine_transform.h"
+#include "clipped_relu.h"
+
+namespace Eval {
+
+namespace NNUE {
+
+namespace Layers {
+
+// Affine transformation of the output of a ClippedReLU. The clipping is done
+// in registers by this layer, the ClippedReLU writes nothing to the buffer.
+// The weights are permuted when they are read, so that each output has its
+// own lane of the accumulators and no horizontal addition is needed, except
+// for the single output of the last layer. The file format, the hash value and
+// the learning class are the same as for the generic AffineTransform.
+template <typename PreviousLayer, IndexType OutputDimensions>
+class AffineTransform<ClippedReLU<PreviousLayer>, OutputDimensions> {
+  using InputLayer = ClippedReLU<PreviousLayer>;
+
+ public:
+  // Input/output type
+  using InputType = typename InputLayer::OutputType;
+  using OutputType = std::int32_t;
+  static_assert(std::is_same_v<InputType, std::uint8_t>, "");
+
+  // number of input/output dimensions
+  static constexpr IndexType kInputDimensions =
+      InputLayer::kOutputDimensions;
+  static constexpr IndexType kOutputDimensions = OutputDimensions;
+  static constexpr IndexType kPaddedInputDimensions =
+      CeilToMultiple<IndexType>(kInputDimensions, kMaxSimdWidth);
+  static_assert(kInputDimensions == kPaddedInputDimensions, "");
+  static_assert(kOutputDimensions == 1 || kOutputDimensions % 8 == 0, "");
+
+  // Size of forward propagation buffer used in this layer
+  static constexpr std::size_t kSelfBufferSize =
+      CeilToMultiple(kOutputDimensions * sizeof(OutputType), kCacheLineSize);
+
+  // Size of the forward propagation buffer used from the input layer to this layer
+  static constexpr std::size_t kBufferSize =
+      InputLayer::kBufferSize + kSelfBufferSize;
+
+  // Hash value embedded in the evaluation function file
+  static constexpr std::uint32_t GetHashValue() {
+    std::uint32_t hash_value = 0xCC03DAE4u;
+    hash_value += kOutputDimensions;
+    hash_value ^= InputLayer::GetHashValue() >> 1;
+    hash_value ^= InputLayer::GetHashValue() << 31;
+    return hash_value;
+  }
+
+  // A string that represents the structure from the input layer to this layer
+  static std::string GetStructureString() {
+    return "AffineTransform[" +
+        std::to_string(kOutputDimensions) + "<-" +
+        std::to_string(kInputDimensions) + "](" +
+        InputLayer::GetStructureString() + ")";
+  }
+
+  // Position in weights_ of the weight of input j for output i
+  static constexpr IndexType GetWeightIndex(const IndexType i, const IndexType j) {
+    if constexpr (kOutputDimensions == 1) {
+#if defined(USE_AVX2)
+      // same order as the clipped inputs, see Clip()
+      constexpr IndexType kQuadLanes[8] = {0, 4, 1, 5, 2, 6, 3, 7};
+      return j / 32 * 32 + kQuadLanes[j % 32 / 4] * 4 + j % 4;
+#else
+      return j;
+#endif
+    } else {
+      // groups of 4 consecutive inputs, for all the outputs
+      return (j / 4 * kOutputDimensions + i) * 4 + j % 4;
+    }
+  }
+
+  // read parameters
+  bool ReadParameters(std::istream& stream) {
+    if (!previous_layer_.ReadParameters(stream)) return false;
+    stream.read(reinterpret_cast<char*>(biases_),
+                kOutputDimensions * sizeof(BiasType));
+    WeightType weights[kOutputDimensions * kPaddedInputDimensions];
+    stream.read(reinterpret_cast<char*>(weights), sizeof(weights));
+    for (IndexType i = 0; i < kOutputDimensions; ++i) {
+      for (IndexType j = 0; j < kPaddedInputDimensions; ++j) {
+        weights_[GetWeightIndex(i, j)] = weights[i * kPaddedInputDimensions + j];
+      }
+    }
+    return !stream.fail();
+  }
+
+  // write parameters
+  bool WriteParameters(std::ostream& stream) const {
+    if (!previous_layer_.WriteParameters(stream)) return false;
+    stream.write(reinterpret_cast<const char*>(biases_),
+                 kOutputDimensions * sizeof(BiasType));
+    WeightType weights[kOutputDimensions * kPaddedInputDimensions];
+    for (IndexType i = 0; i < kOutputDimensions; ++i) {
+      for (IndexType j = 0; j < kPaddedInputDimensions; ++j) {
+        weights[i * kPaddedInputDimensions + j] = weights_[GetWeightIndex(i, j)];
+      }
+    }
+    stream.write(reinterpret_cast<const char*>(weights), sizeof(weights));
+    return !stream.fail();
+  }
+
+  // forward propagation
+  const OutputType* Propagate(
+      const TransformedFeatureType* transformed_features, char* buffer) const {
+    const auto input = previous_layer_.PropagateUnclipped(
+        transformed_features, buffer + kSelfBufferSize);
+    const auto output = reinterpret_cast<OutputType*>(buffer);
+#if defined(USE_AVX2)
+    constexpr IndexType kNumChunks = kInputDimensions / 32;
+    const __m256i kOnes = _mm256_set1_epi16(1);
+    const auto in = reinterpret_cast<const __m256i*>(input);
+    const auto w = reinterpret_cast<const __m256i*>(weights_);
+    if constexpr (kOutputDimensions == 1) {
+      __m256i sum = _mm256_setzero_si256();
+      for (IndexType c = 0; c < kNumChunks; ++c) {
+        const __m256i product = _mm256_maddubs_epi16(Clip(&in[c * 4]), _mm256_load_si256(&w[c]));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(product, kOnes));
+      }
+      __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+      sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_SHUFFLE(1, 0, 3, 2)));
+      sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_SHUFFLE(2, 3, 0, 1)));
+      output[0] = _mm_cvtsi128_si32(sum128) + biases_[0];
+    } else {
+      // 8 outputs per register, each output accumulates the products of a
+      // group of 4 inputs, broadcast to all the lanes
+      constexpr IndexType kNumRegs = kOutputDimensions / 8;
+      constexpr int kQuadLanes[8] = {0, 4, 1, 5, 2, 6, 3, 7};
+      const auto biases = reinterpret_cast<const __m256i*>(biases_);
+      __m256i sum[kNumRegs];
+      for (IndexType r = 0; r < kNumRegs; ++r) {
+        sum[r] = _mm256_load_si256(&biases[r]);
+      }
+      for (IndexType c = 0; c < kNumChunks; ++c) {
+        const __m256i clipped = Clip(&in[c * 4]);
+        for (IndexType q = 0; q < 8; ++q) {
+          const __m256i quad = _mm256_permutevar8x32_epi32(clipped, _mm256_set1_epi32(kQuadLanes[q]));
+          const auto row = &w[(c * 8 + q) * kNumRegs];
+          for (IndexType r = 0; r < kNumRegs; ++r) {
+            const __m256i product = _mm256_maddubs_epi16(quad, _mm256_load_si256(&row[r]));
+            sum[r] = _mm256_add_epi32(sum[r], _mm256_madd_epi16(product, kOnes));
+          }
+        }
+      }
+      const auto out = reinterpret_cast<__m256i*>(output);
+      for (IndexType r = 0; r < kNumRegs; ++r) {
+        _mm256_storeu_si256(&out[r], sum[r]);
+      }
+    }
+#else
+    constexpr IndexType kNumChunks = kInputDimensions / 16;
+    const __m128i kOnes = _mm_set1_epi16(1);
+    const auto in = reinterpret_cast<const __m128i*>(input);
+    const auto w = reinterpret_cast<const __m128i*>(weights_);
+    if constexpr (kOutputDimensions == 1) {
+      __m128i sum = _mm_setzero_si128();
+      for (IndexType c = 0; c < kNumChunks; ++c) {
+        const __m128i product = _mm_maddubs_epi16(Clip(&in[c * 4]), _mm_load_si128(&w[c]));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(product, kOnes));
+      }
+      sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+      sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+      output[0] = _mm_cvtsi128_si32(sum) + biases_[0];
+    } else {
+      // 4 outputs per register, as above
+      constexpr IndexType kNumRegs = kOutputDimensions / 4;
+      const auto biases = reinterpret_cast<const __m128i*>(biases_);
+      __m128i sum[kNumRegs];
+      for (IndexType r = 0; r < kNumRegs; ++r) {
+        sum[r] = _mm_load_si128(&biases[r]);
+      }
+      const auto accumulate = [&](const __m128i quad, const __m128i* row) {
+        for (IndexType r = 0; r < kNumRegs; ++r) {
+          const __m128i product = _mm_maddubs_epi16(quad, _mm_load_si128(&row[r]));
+          sum[r] = _mm_add_epi32(sum[r], _mm_madd_epi16(product, kOnes));
+        }
+      };
+      for (IndexType c = 0; c < kNumChunks; ++c) {
+        const __m128i clipped = Clip(&in[c * 4]);
+        const auto row = &w[c * 4 * kNumRegs];
+        accumulate(_mm_shuffle_epi32(clipped, 0x00), &row[0 * kNumRegs]);
+        accumulate(_mm_shuffle_epi32(clipped, 0x55), &row[1 * kNumRegs]);
+        accumulate(_mm_shuffle_epi32(clipped, 0xAA), &row[2 * kNumRegs]);
+        accumulate(_mm_shuffle_epi32(clipped, 0xFF), &row[3 * kNumRegs]);
+      }
+      const auto out = reinterpret_cast<__m128i*>(output);
+      for (IndexType r = 0; r < kNumRegs; ++r) {
+        _mm_storeu_si128(&out[r], sum[r]);
+      }
+    }
+#endif
+    return output;
+  }
+
+ private:
+  // parameter type
+  using BiasType = OutputType;
+  using WeightType = std::int8_t;
+
+#if defined(USE_AVX2)
+  // Clipped ReLU of 32 inputs, as ClippedReLU::Propagate() but without the
+  // final permutation: the packing works within the 128-bit lanes, so that the
+  // group of 4 inputs 4q..4q+3 is in the 32-bit lane {0, 4, 1, 5, 2, 6, 3, 7}[q].
+  static __m256i Clip(const __m256i* in) {
+    const __m256i words0 = _mm256_srai_epi16(_mm256_packs_epi32(
+        _mm256_loadu_si256(&in[0]), _mm256_loadu_si256(&in[1])), kWeightScaleBits);
+    const __m256i words1 = _mm256_srai_epi16(_mm256_packs_epi32(
+        _mm256_loadu_si256(&in[2]), _mm256_loadu_si256(&in[3])), kWeightScaleBits);
+    return _mm256_max_epi8(_mm256_packs_epi16(words0, words1), _mm256_setzero_si256());
+  }
+#else
+  // Clipped ReLU of 16 inputs, in order
+  static __m128i Clip(const __m128i* in) {
+    const __m128i words0 = _mm_srai_epi16(_mm_packs_epi32(
+        _mm_loadu_si128(&in[0]), _mm_loadu_si128(&in[1])), kWeightScaleBits);
+    const __m128i words1 = _mm_srai_epi16(_mm_packs_epi32(
+        _mm_loadu_si128(&in[2]), _mm_loadu_si128(&in[3])), kWeightScaleBits);
+    const __m128i packedbytes = _mm_packs_epi16(words0, words1);
+#if defined(USE_SSE41)
+    return _mm_max_epi8(packedbytes, _mm_setzero_si128());
+#else
+    const __m128i k0x80s = _mm_set1_epi8(-128);
+    return _mm_subs_epi8(_mm_adds_epi8(packedbytes, k0x80s), k0x80s);
+#endif
+  }
+#endif
+
+  // Make the learning class a friend
+  friend class Trainer<AffineTransform>;
+
+  // the layer immediately before this layer
+  InputLayer previous_layer_;
+
+  // parameter
+  alignas(kCacheLineSize) BiasType biases_[kOutputDimensions];
+  alignas(kCacheLineSize)
+      WeightType weights_[kOutputDimensions * kPaddedInputDimensions];
+};
+
+}  // namespace Layers
+
+}  // namespace NNUE
+
+}  // namespace Eval
+
+#endif  // defined(EVAL_NNUE) && defined(USE_SSSE3)
+
+#endif
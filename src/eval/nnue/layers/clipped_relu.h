@@ -158,6 +158,14 @@ class ClippedReLU {
     return output;
   }
 
+  // forward propagation of the previous layer only, for the next layer that
+  // does the clipping itself, see affine_transform_clipped.h
+  const InputType* PropagateUnclipped(
+      const TransformedFeatureType* transformed_features, char* buffer) const {
+    return previous_layer_.Propagate(
+        transformed_features, buffer + kSelfBufferSize);
+  }
+
  private:
   // Make the learning class a friend
   friend class Trainer<ClippedReLU>;
@@ -13,9 +13,10 @@ namespace NNUE {
 
 // Class that holds the result of affine transformation of input features
 // Keep the evaluation value that is the final output together
+// The values of each refresh trigger follow each other, then their sum when
+// there are several triggers. Sized for the largest architecture built in.
 struct alignas(32) Accumulator {
-  std::int16_t
-      accumulation[2][kRefreshTriggers.size()][kTransformedFeatureDimensions];
+  std::int16_t accumulation[2][kMaxAccumulatorDimensions];
   Value score = VALUE_ZERO;
   bool computed_accumulation = false;
   bool computed_score = false;
@@ -5,25 +5,122 @@
 
 #if defined(EVAL_NNUE)
 
-// include a header that defines the input features and network structure
-//#include "architectures/k-p_256x2-32-32.h"
-//#include "architectures/k-p-cr_256x2-32-32.h"
-//#include "architectures/k-p-cr-ep_256x2-32-32.h"
+// include the headers that define the input features and network structures
+#include "architectures/k-p_256x2-32-32.h"
+#include "architectures/k-p-cr_256x2-32-32.h"
+#include "architectures/k-p-cr-ep_256x2-32-32.h"
 #include "architectures/halfkp_256x2-32-32.h"
-//#include "architectures/halfkp-cr-ep_256x2-32-32.h"
-//#include "architectures/halfkp_384x2-32-32.h"
+#include "architectures/halfkp-cr-ep_256x2-32-32.h"
+#include "architectures/halfkp_384x2-32-32.h"
+
+#include <algorithm>
+#include <type_traits>
 
 namespace Eval {
 
 namespace NNUE {
 
-static_assert(kTransformedFeatureDimensions % kMaxSimdWidth == 0, "");
-static_assert(Network::kOutputDimensions == 1, "");
-static_assert(std::is_same_v<Network::OutputType, std::int32_t>, "");
+// Variant of an architecture whose feature transformer stores its weights as
+// int8, with a shift per feature, instead of int16: half the memory traffic
+// of the incremental updates, at the cost of precision on the large weights.
+template <typename BaseArchitecture>
+struct Int8Weights : BaseArchitecture {
+  static constexpr bool kInt8Weights = true;
+};
+
+template <typename Architecture, typename = void>
+constexpr bool kHasInt8Weights = false;
+template <typename Architecture>
+constexpr bool kHasInt8Weights<Architecture, std::void_t<decltype(Architecture::kInt8Weights)>> =
+    Architecture::kInt8Weights;
+
+namespace Architectures {
+
+struct HalfKP_256x2_32_32_Int8 : Int8Weights<HalfKP_256x2_32_32> {
+  static constexpr const char* kName = "halfkp_256x2-32-32-int8";
+};
+
+struct HalfKP_384x2_32_32_Int8 : Int8Weights<HalfKP_384x2_32_32> {
+  static constexpr const char* kName = "halfkp_384x2-32-32-int8";
+};
+
+}  // namespace Architectures
+
+// Number of accumulator slices of one side for the given refresh triggers:
+// one per trigger, plus their running sum when there are several triggers
+constexpr IndexType AccumulatorSlices(const std::size_t num_triggers) {
+  return static_cast<IndexType>(num_triggers > 1 ? num_triggers + 1 : num_triggers);
+}
+
+// List of architectures compiled in, sizes shared data for the largest one
+template <typename... ArchitectureTypes>
+struct ArchitectureList {
+
+  // Maximum number of indices of active features, for all architectures
+  static constexpr IndexType kMaxActiveIndices =
+      std::max({ArchitectureTypes::RawFeatures::kMaxActiveDimensions...});
+
+  // Maximum number of accumulated values for one side, for all architectures
+  static constexpr IndexType kMaxAccumulatorDimensions =
+      std::max({AccumulatorSlices(ArchitectureTypes::RawFeatures::kRefreshTriggers.size()) *
+                ArchitectureTypes::kTransformedFeatureDimensions...});
+
+  static_assert(((ArchitectureTypes::kTransformedFeatureDimensions % kMaxSimdWidth == 0) && ...), "");
+  static_assert(((ArchitectureTypes::Network::kOutputDimensions == 1) && ...), "");
+  static_assert((std::is_same_v<typename ArchitectureTypes::Network::OutputType, std::int32_t> && ...), "");
+};
+
+// Networks of any of these architectures can be loaded, the one of a file is
+// recognized by the hash value in its header. The accumulator in every StateInfo
+// is sized for the largest one, so by default only the architectures with a
+// single slice of 256 values per side are built in: the others would make each
+// StateInfo up to three times larger, and the search slower with any network.
+// They are added by "make nnuearchs=all", that defines NNUE_ALL_ARCHITECTURES.
+#if defined(NNUE_ALL_ARCHITECTURES)
+using BuiltinArchitectures = ArchitectureList<
+    Architectures::HalfKP_256x2_32_32,
+    Architectures::HalfKP_384x2_32_32,
+    Architectures::HalfKP_256x2_32_32_Int8,
+    Architectures::HalfKP_384x2_32_32_Int8,
+    Architectures::HalfKP_CR_EP_256x2_32_32,
+    Architectures::K_P_256x2_32_32,
+    Architectures::K_P_CR_256x2_32_32,
+    Architectures::K_P_CR_EP_256x2_32_32>;
+#else
+using BuiltinArchitectures = ArchitectureList<
+    Architectures::HalfKP_256x2_32_32,
+    Architectures::HalfKP_256x2_32_32_Int8,
+    Architectures::K_P_256x2_32_32,
+    Architectures::K_P_CR_256x2_32_32>;
+#endif
+
+// Architecture of the networks trained by the learner
+//using DefaultArchitecture = Architectures::K_P_256x2_32_32;
+//using DefaultArchitecture = Architectures::K_P_CR_256x2_32_32;
+//using DefaultArchitecture = Architectures::K_P_CR_EP_256x2_32_32;
+using DefaultArchitecture = Architectures::HalfKP_256x2_32_32;
+//using DefaultArchitecture = Architectures::HalfKP_256x2_32_32_Int8;
+//using DefaultArchitecture = Architectures::HalfKP_CR_EP_256x2_32_32;
+//using DefaultArchitecture = Architectures::HalfKP_384x2_32_32;
+
+// Input features used in evaluation function
+using RawFeatures = DefaultArchitecture::RawFeatures;
+
+// Number of input feature dimensions after conversion
+constexpr IndexType kTransformedFeatureDimensions = DefaultArchitecture::kTransformedFeatureDimensions;
+
+using Network = DefaultArchitecture::Network;
 
 // List of timings to perform all calculations instead of difference calculation
 constexpr auto kRefreshTriggers = RawFeatures::kRefreshTriggers;
 
+// Size of the index lists and of the accumulator
+constexpr IndexType kMaxActiveIndices = BuiltinArchitectures::kMaxActiveIndices;
+constexpr IndexType kMaxAccumulatorDimensions = BuiltinArchitectures::kMaxAccumulatorDimensions;
+
+static_assert(AccumulatorSlices(kRefreshTriggers.size()) * kTransformedFeatureDimensions <= kMaxAccumulatorDimensions,
+              "DefaultArchitecture is not built in, use make nnuearchs=all");
+
 }  // namespace NNUE
 
 }  // namespace Eval
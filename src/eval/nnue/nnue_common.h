@@ -22,6 +22,11 @@ namespace NNUE {
 // A constant that represents the version of the evaluation function file
 constexpr std::uint32_t kVersion = 0x7AF32F16u;
 
+// Version of the files whose feature transformer has int8 weights, each
+// feature with a shift to apply to its weights
+constexpr std::uint32_t kVersionInt8Weights = 0x7AF32F17u;
+constexpr int kMaxWeightShift = 8;
+
 // Constant used in evaluation value calculation
 constexpr int FV_SCALE = 16;
 constexpr int kWeightScaleBits = 6;
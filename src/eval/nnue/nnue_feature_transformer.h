@@ -8,22 +8,45 @@
 #include "nnue_common.h"
 #include "nnue_architecture.h"
 #include "features/index_list.h"
+#include "../../searchstats.h"
 
+#include <algorithm>
 #include <cstring> // std::memset()
+#include <type_traits>
 
 namespace Eval {
 
 namespace NNUE {
 
-// Input feature converter
-class FeatureTransformer {
+// Input feature converter of the given architecture
+template <typename Architecture>
+class BasicFeatureTransformer {
+  // Input features used in evaluation function
+  using RawFeatures = typename Architecture::RawFeatures;
+
+  // List of timings to perform all calculations instead of difference calculation
+  static constexpr auto kRefreshTriggers = RawFeatures::kRefreshTriggers;
+
 	// number of output dimensions for one side
-  static constexpr IndexType kHalfDimensions = kTransformedFeatureDimensions;
+  static constexpr IndexType kHalfDimensions = Architecture::kTransformedFeatureDimensions;
+
+  // With several refresh triggers, the sum of their slices is kept up to date
+  // in an extra slice, so that Transform() reads a single one
+  static constexpr bool kKeepsSum = kRefreshTriggers.size() > 1;
+  static constexpr IndexType kSumOffset = kKeepsSum ? kRefreshTriggers.size() * kHalfDimensions : 0;
+
+  static_assert(AccumulatorSlices(kRefreshTriggers.size()) * kHalfDimensions <= kMaxAccumulatorDimensions, "");
 
  public:
   // output type
   using OutputType = TransformedFeatureType;
 
+  // Weights stored as int8 with a shift per feature, instead of int16
+  static constexpr bool kInt8Weights = kHasInt8Weights<Architecture>;
+
+  // Version of the evaluation function file, that tells the weight layout
+  static constexpr std::uint32_t kFileVersion = kInt8Weights ? kVersionInt8Weights : kVersion;
+
   // number of input/output dimensions
   static constexpr IndexType kInputDimensions = RawFeatures::kDimensions;
   static constexpr IndexType kOutputDimensions = kHalfDimensions * 2;
@@ -34,14 +57,14 @@ class FeatureTransformer {
 
   // Hash value embedded in the evaluation function file
   static constexpr std::uint32_t GetHashValue() {
-    return RawFeatures::kHashValue ^ kOutputDimensions;
+    return RawFeatures::kHashValue ^ kOutputDimensions ^ (kInt8Weights ? 0x8B175EEDu : 0);
   }
 
   // a string representing the structure
   static std::string GetStructureString() {
     return RawFeatures::GetName() + "[" +
         std::to_string(kInputDimensions) + "->" +
-        std::to_string(kHalfDimensions) + "x2]";
+        std::to_string(kHalfDimensions) + "x2" + (kInt8Weights ? ",int8" : "") + "]";
   }
 
   // read parameters
@@ -51,6 +74,13 @@ class FeatureTransformer {
                 kHalfDimensions * sizeof(BiasType));
     stream.read(reinterpret_cast<char*>(weights_),
         static_cast<unsigned long long>(kHalfDimensions) * kInputDimensions * sizeof(WeightType));
+    if constexpr (kInt8Weights) {
+      stream.read(reinterpret_cast<char*>(weight_shifts_), sizeof(weight_shifts_));
+      if (std::any_of(std::begin(weight_shifts_), std::end(weight_shifts_),
+                      [](const std::uint8_t shift) { return shift > kMaxWeightShift; })) {
+        return false;
+      }
+    }
     return !stream.fail();
   }
 
@@ -60,6 +90,9 @@ class FeatureTransformer {
                  kHalfDimensions * sizeof(BiasType));
     stream.write(reinterpret_cast<const char*>(weights_),
                  kHalfDimensions * kInputDimensions * sizeof(WeightType));
+    if constexpr (kInt8Weights) {
+      stream.write(reinterpret_cast<const char*>(weight_shifts_), sizeof(weight_shifts_));
+    }
     return !stream.fail();
   }
 
@@ -76,6 +109,35 @@ class FeatureTransformer {
     return false;
   }
 
+#if defined(NNUE_PREFETCH_WEIGHTS)
+  // Prefetch the weights of the features changed by the last move, that the
+  // difference calculation will read. Called from do_move(), long before the
+  // evaluation. A reset reads all the active features, these are not prefetched.
+  void PrefetchWeights(const Position& pos) const {
+    Features::IndexList removed_indices[2], added_indices[2];
+    for (const auto trigger : kRefreshTriggers) {
+      bool reset[2] = {false, false};
+      for (const auto perspective : Colors) {
+        removed_indices[perspective].resize(0);
+        added_indices[perspective].resize(0);
+      }
+      RawFeatures::AppendChangedIndices(pos, trigger,
+                                        removed_indices, added_indices, reset);
+      for (const auto perspective : Colors) {
+        if (reset[perspective]) {
+          continue;
+        }
+        for (const auto index : removed_indices[perspective]) {
+          PrefetchColumn(index);
+        }
+        for (const auto index : added_indices[perspective]) {
+          PrefetchColumn(index);
+        }
+      }
+    }
+  }
+#endif  // defined(NNUE_PREFETCH_WEIGHTS)
+
   // convert input features
   void Transform(const Position& pos, OutputType* output, const bool refresh) const {
     if (refresh || !UpdateAccumulatorIfPossible(pos)) {
@@ -112,7 +174,7 @@ class FeatureTransformer {
           _mm256_load_si256
 #endif
           (&reinterpret_cast<const __m256i*>(
-            accumulation[perspectives[p]][0])[j * 2 + 0]);
+            &accumulation[perspectives[p]][kSumOffset])[j * 2 + 0]);
         __m256i sum1 =
 #if defined(__MINGW32__) || defined(__MINGW64__)
           _mm256_loadu_si256
@@ -120,13 +182,7 @@ class FeatureTransformer {
           _mm256_load_si256
 #endif
           (&reinterpret_cast<const __m256i*>(
-            accumulation[perspectives[p]][0])[j * 2 + 1]);
-        for (IndexType i = 1; i < kRefreshTriggers.size(); ++i) {
-          sum0 = _mm256_add_epi16(sum0, reinterpret_cast<const __m256i*>(
-              accumulation[perspectives[p]][i])[j * 2 + 0]);
-          sum1 = _mm256_add_epi16(sum1, reinterpret_cast<const __m256i*>(
-              accumulation[perspectives[p]][i])[j * 2 + 1]);
-        }
+            &accumulation[perspectives[p]][kSumOffset])[j * 2 + 1]);
 #if defined(__MINGW32__) || defined(__MINGW64__)
         _mm256_storeu_si256
 #else
@@ -139,15 +195,9 @@ class FeatureTransformer {
       auto out = reinterpret_cast<__m128i*>(&output[offset]);
       for (IndexType j = 0; j < kNumChunks; ++j) {
         __m128i sum0 = _mm_load_si128(&reinterpret_cast<const __m128i*>(
-            accumulation[perspectives[p]][0])[j * 2 + 0]);
+            &accumulation[perspectives[p]][kSumOffset])[j * 2 + 0]);
         __m128i sum1 = _mm_load_si128(&reinterpret_cast<const __m128i*>(
-            accumulation[perspectives[p]][0])[j * 2 + 1]);
-        for (IndexType i = 1; i < kRefreshTriggers.size(); ++i) {
-          sum0 = _mm_add_epi16(sum0, reinterpret_cast<const __m128i*>(
-              accumulation[perspectives[p]][i])[j * 2 + 0]);
-          sum1 = _mm_add_epi16(sum1, reinterpret_cast<const __m128i*>(
-              accumulation[perspectives[p]][i])[j * 2 + 1]);
-        }
+            &accumulation[perspectives[p]][kSumOffset])[j * 2 + 1]);
   	const __m128i packedbytes = _mm_packs_epi16(sum0, sum1);
  
         _mm_store_si128(&out[j],
@@ -162,19 +212,12 @@ class FeatureTransformer {
       const auto out = reinterpret_cast<int8x8_t*>(&output[offset]);
       for (IndexType j = 0; j < kNumChunks; ++j) {
         int16x8_t sum = reinterpret_cast<const int16x8_t*>(
-            accumulation[perspectives[p]][0])[j];
-        for (IndexType i = 1; i < kRefreshTriggers.size(); ++i) {
-          sum = vaddq_s16(sum, reinterpret_cast<const int16x8_t*>(
-              accumulation[perspectives[p]][i])[j]);
-        }
+            &accumulation[perspectives[p]][kSumOffset])[j];
         out[j] = vmax_s8(vqmovn_s16(sum), kZero);
       }
 #else
       for (IndexType j = 0; j < kHalfDimensions; ++j) {
-        BiasType sum = accumulation[static_cast<int>(perspectives[p])][0][j];
-        for (IndexType i = 1; i < kRefreshTriggers.size(); ++i) {
-          sum += accumulation[static_cast<int>(perspectives[p])][i][j];
-        }
+        BiasType sum = accumulation[static_cast<int>(perspectives[p])][kSumOffset + j];
         output[offset + j] = static_cast<OutputType>(
             std::max<int>(0, std::min<int>(127, sum)));
       }
@@ -185,6 +228,7 @@ class FeatureTransformer {
  private:
   // Calculate cumulative value without using difference calculation
   void RefreshAccumulator(const Position& pos) const {
+    STATS_INC(SearchStats::NNUE_REFRESHES);
     auto& accumulator = pos.state()->accumulator;
     for (IndexType i = 0; i < kRefreshTriggers.size(); ++i) {
       Features::IndexList active_indices[2];
@@ -192,161 +236,224 @@ class FeatureTransformer {
                                        active_indices);
       for (const auto perspective : Colors) {
         if (i == 0) {
-          std::memcpy(accumulator.accumulation[perspective][i], biases_,
+          std::memcpy(&accumulator.accumulation[perspective][i * kHalfDimensions], biases_,
                       kHalfDimensions * sizeof(BiasType));
         } else {
-          std::memset(accumulator.accumulation[perspective][i], 0,
+          std::memset(&accumulator.accumulation[perspective][i * kHalfDimensions], 0,
                       kHalfDimensions * sizeof(BiasType));
         }
         for (const auto index : active_indices[perspective]) {
-          const IndexType offset = kHalfDimensions * index;
-#if defined(USE_AVX2)
-          const auto accumulation = reinterpret_cast<__m256i*>(
-              &accumulator.accumulation[perspective][i][0]);
-          const auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
-          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-          for (IndexType j = 0; j < kNumChunks; ++j) {
-#if defined(__MINGW32__) || defined(__MINGW64__)
-            _mm256_storeu_si256(&accumulation[j], _mm256_add_epi16(_mm256_loadu_si256(&accumulation[j]), column[j]));
-#else
-            accumulation[j] = _mm256_add_epi16(accumulation[j], column[j]);
-#endif
-          }
-#elif defined(USE_SSE2)
-          auto accumulation = reinterpret_cast<__m128i*>(
-              &accumulator.accumulation[perspective][i][0]);
-          auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
-          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-          for (IndexType j = 0; j < kNumChunks; ++j) {
-            accumulation[j] = _mm_add_epi16(accumulation[j], column[j]);
-          }
-#elif defined(IS_ARM)
-          auto accumulation = reinterpret_cast<int16x8_t*>(
-              &accumulator.accumulation[perspective][i][0]);
-          auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
-          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-          for (IndexType j = 0; j < kNumChunks; ++j) {
-            accumulation[j] = vaddq_s16(accumulation[j], column[j]);
-          }
-#else
-          for (IndexType j = 0; j < kHalfDimensions; ++j) {
-            accumulator.accumulation[perspective][i][j] += weights_[offset + j];
-          }
-#endif
+          AddColumn(&accumulator.accumulation[perspective][i * kHalfDimensions], index);
         }
       }
     }
 
+    if constexpr (kKeepsSum) {
+      for (const auto perspective : Colors) {
+        SumSlices(accumulator.accumulation[perspective]);
+      }
+    }
+
     accumulator.computed_accumulation = true;
     accumulator.computed_score = false;
   }
 
   // Calculate cumulative value using difference calculation
   void UpdateAccumulator(const Position& pos) const {
-    const auto prev_accumulator = pos.state()->previous->accumulator;
+    STATS_INC(SearchStats::NNUE_UPDATES);
+    STATS_ADD(SearchStats::NNUE_DIRTY_PIECES, pos.state()->dirtyPiece.dirty_num);
+    const auto& prev_accumulator = pos.state()->previous->accumulator;
     auto& accumulator = pos.state()->accumulator;
+    // The sum gets the same differences as the slices, unless a slice is
+    // reset, in which case it is summed again at the end
+    bool reset_sum[2] = {false, false};
+    if constexpr (kKeepsSum) {
+      for (const auto perspective : Colors) {
+        std::memcpy(&accumulator.accumulation[perspective][kSumOffset],
+                    &prev_accumulator.accumulation[perspective][kSumOffset],
+                    kHalfDimensions * sizeof(BiasType));
+      }
+    }
     for (IndexType i = 0; i < kRefreshTriggers.size(); ++i) {
       Features::IndexList removed_indices[2], added_indices[2];
       bool reset[2];
       RawFeatures::AppendChangedIndices(pos, kRefreshTriggers[i],
                                         removed_indices, added_indices, reset);
       for (const auto perspective : Colors) {
-#if defined(USE_AVX2)
-        constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-        const auto accumulation = reinterpret_cast<__m256i*>(
-            &accumulator.accumulation[perspective][i][0]);
-#elif defined(USE_SSE2)
-        constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-        auto accumulation = reinterpret_cast<__m128i*>(
-            &accumulator.accumulation[perspective][i][0]);
-#elif defined(IS_ARM)
-        constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-        auto accumulation = reinterpret_cast<int16x8_t*>(
-            &accumulator.accumulation[perspective][i][0]);
-#endif
+        const auto accumulation = &accumulator.accumulation[perspective][i * kHalfDimensions];
         if (reset[perspective]) {
+          reset_sum[perspective] = true;
           if (i == 0) {
-            std::memcpy(accumulator.accumulation[perspective][i], biases_,
-                        kHalfDimensions * sizeof(BiasType));
+            std::memcpy(accumulation, biases_, kHalfDimensions * sizeof(BiasType));
           } else {
-            std::memset(accumulator.accumulation[perspective][i], 0,
-                        kHalfDimensions * sizeof(BiasType));
+            std::memset(accumulation, 0, kHalfDimensions * sizeof(BiasType));
           }
         } else {// Difference calculation for the feature amount changed from 1 to 0
-          std::memcpy(accumulator.accumulation[perspective][i],
-                      prev_accumulator.accumulation[perspective][i],
+          std::memcpy(accumulation, &prev_accumulator.accumulation[perspective][i * kHalfDimensions],
                       kHalfDimensions * sizeof(BiasType));
           for (const auto index : removed_indices[perspective]) {
-            const IndexType offset = kHalfDimensions * index;
-#if defined(USE_AVX2)
-            const auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm256_sub_epi16(accumulation[j], column[j]);
+            AddColumn<true>(accumulation, index);
+            if constexpr (kKeepsSum) {
+              if (!reset_sum[perspective]) {
+                AddColumn<true>(&accumulator.accumulation[perspective][kSumOffset], index);
+              }
             }
-#elif defined(USE_SSE2)
-            auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm_sub_epi16(accumulation[j], column[j]);
-            }
-#elif defined(IS_ARM)
-            auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = vsubq_s16(accumulation[j], column[j]);
-            }
-#else
-            for (IndexType j = 0; j < kHalfDimensions; ++j) {
-              accumulator.accumulation[perspective][i][j] -=
-                  weights_[offset + j];
-            }
-#endif
           }
         }
         {// Difference calculation for features that changed from 0 to 1
           for (const auto index : added_indices[perspective]) {
-            const IndexType offset = kHalfDimensions * index;
-#if defined(USE_AVX2)
-            const auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm256_add_epi16(accumulation[j], column[j]);
-            }
-#elif defined(USE_SSE2)
-            auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm_add_epi16(accumulation[j], column[j]);
-            }
-#elif defined(IS_ARM)
-            auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = vaddq_s16(accumulation[j], column[j]);
-            }
-#else
-            for (IndexType j = 0; j < kHalfDimensions; ++j) {
-              accumulator.accumulation[perspective][i][j] +=
-                  weights_[offset + j];
+            AddColumn(accumulation, index);
+            if constexpr (kKeepsSum) {
+              if (!reset_sum[perspective]) {
+                AddColumn(&accumulator.accumulation[perspective][kSumOffset], index);
+              }
             }
-#endif
           }
         }
       }
     }
 
+    if constexpr (kKeepsSum) {
+      for (const auto perspective : Colors) {
+        if (reset_sum[perspective]) {
+          SumSlices(accumulator.accumulation[perspective]);
+        }
+      }
+    }
+
     accumulator.computed_accumulation = true;
     accumulator.computed_score = false;
   }
 
+#if defined(NNUE_PREFETCH_WEIGHTS)
+  // Prefetch the cache lines of the weights of a feature
+  void PrefetchColumn(const IndexType index) const {
+    const auto column = reinterpret_cast<const char*>(&weights_[kHalfDimensions * index]);
+    for (std::size_t offset = 0; offset < kHalfDimensions * sizeof(WeightType); offset += kCacheLineSize) {
+      prefetch(const_cast<char*>(column + offset));
+    }
+  }
+#endif  // defined(NNUE_PREFETCH_WEIGHTS)
+
+  // Add (or subtract) a vector of kHalfDimensions values to a slice
+  template <bool kSubtract = false>
+  static void AddVector(std::int16_t* slice, const std::int16_t* values) {
+#if defined(USE_AVX2)
+    constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+    const auto accumulation = reinterpret_cast<__m256i*>(slice);
+    const auto column = reinterpret_cast<const __m256i*>(values);
+    for (IndexType j = 0; j < kNumChunks; ++j) {
+#if defined(__MINGW32__) || defined(__MINGW64__)
+      const __m256i sum = _mm256_loadu_si256(&accumulation[j]);
+      _mm256_storeu_si256(&accumulation[j], kSubtract ? _mm256_sub_epi16(sum, column[j])
+                                                      : _mm256_add_epi16(sum, column[j]));
+#else
+      accumulation[j] = kSubtract ? _mm256_sub_epi16(accumulation[j], column[j])
+                                  : _mm256_add_epi16(accumulation[j], column[j]);
+#endif
+    }
+#elif defined(USE_SSE2)
+    constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+    auto accumulation = reinterpret_cast<__m128i*>(slice);
+    auto column = reinterpret_cast<const __m128i*>(values);
+    for (IndexType j = 0; j < kNumChunks; ++j) {
+      accumulation[j] = kSubtract ? _mm_sub_epi16(accumulation[j], column[j])
+                                  : _mm_add_epi16(accumulation[j], column[j]);
+    }
+#elif defined(IS_ARM)
+    constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+    auto accumulation = reinterpret_cast<int16x8_t*>(slice);
+    auto column = reinterpret_cast<const int16x8_t*>(values);
+    for (IndexType j = 0; j < kNumChunks; ++j) {
+      accumulation[j] = kSubtract ? vsubq_s16(accumulation[j], column[j])
+                                  : vaddq_s16(accumulation[j], column[j]);
+    }
+#else
+    for (IndexType j = 0; j < kHalfDimensions; ++j) {
+      slice[j] = kSubtract ? slice[j] - values[j] : slice[j] + values[j];
+    }
+#endif
+  }
+
+  // Add (or subtract) the weights of a feature to a slice. Weights stored as
+  // int8 are sign extended and shifted back to int16 on the fly.
+  template <bool kSubtract = false>
+  void AddColumn(std::int16_t* slice, const IndexType index) const {
+    const IndexType offset = kHalfDimensions * index;
+    if constexpr (!kInt8Weights) {
+      AddVector<kSubtract>(slice, &weights_[offset]);
+    } else {
+      const int shift = weight_shifts_[index];
+#if defined(USE_AVX2)
+      constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+      const auto accumulation = reinterpret_cast<__m256i*>(slice);
+      const auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
+      const __m128i count = _mm_cvtsi32_si128(shift);
+      for (IndexType j = 0; j < kNumChunks; ++j) {
+        const __m256i weights = _mm256_sll_epi16(_mm256_cvtepi8_epi16(_mm_load_si128(&column[j])), count);
+        accumulation[j] = kSubtract ? _mm256_sub_epi16(accumulation[j], weights)
+                                    : _mm256_add_epi16(accumulation[j], weights);
+      }
+#elif defined(USE_SSE2)
+      constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+      auto accumulation = reinterpret_cast<__m128i*>(slice);
+      const __m128i count = _mm_cvtsi32_si128(shift);
+      for (IndexType j = 0; j < kNumChunks; ++j) {
+        const __m128i bytes = _mm_loadl_epi64(
+            reinterpret_cast<const __m128i*>(&weights_[offset + j * (kSimdWidth / 2)]));
+#if defined(USE_SSE41)
+        const __m128i weights = _mm_sll_epi16(_mm_cvtepi8_epi16(bytes), count);
+#else
+        const __m128i weights = _mm_sll_epi16(_mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8), count);
+#endif
+        accumulation[j] = kSubtract ? _mm_sub_epi16(accumulation[j], weights)
+                                    : _mm_add_epi16(accumulation[j], weights);
+      }
+#elif defined(IS_ARM)
+      constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+      auto accumulation = reinterpret_cast<int16x8_t*>(slice);
+      const int16x8_t count = vdupq_n_s16(shift);
+      for (IndexType j = 0; j < kNumChunks; ++j) {
+        const int16x8_t weights = vshlq_s16(vmovl_s8(vld1_s8(&weights_[offset + j * (kSimdWidth / 2)])), count);
+        accumulation[j] = kSubtract ? vsubq_s16(accumulation[j], weights)
+                                    : vaddq_s16(accumulation[j], weights);
+      }
+#else
+      for (IndexType j = 0; j < kHalfDimensions; ++j) {
+        const int weight = weights_[offset + j] * (1 << shift);
+        slice[j] = kSubtract ? slice[j] - weight : slice[j] + weight;
+      }
+#endif
+    }
+  }
+
+  // Recompute the sum slice of one side from the slices of the refresh triggers
+  static void SumSlices(std::int16_t* accumulation) {
+    std::memcpy(&accumulation[kSumOffset], &accumulation[0],
+                kHalfDimensions * sizeof(BiasType));
+    for (IndexType i = 1; i < kRefreshTriggers.size(); ++i) {
+      AddVector(&accumulation[kSumOffset], &accumulation[i * kHalfDimensions]);
+    }
+  }
+
   // parameter type
   using BiasType = std::int16_t;
-  using WeightType = std::int16_t;
+  using WeightType = std::conditional_t<kInt8Weights, std::int8_t, std::int16_t>;
 
   // Make the learning class a friend
-  friend class Trainer<FeatureTransformer>;
+  friend class Trainer<BasicFeatureTransformer>;
 
   // parameter
   alignas(kCacheLineSize) BiasType biases_[kHalfDimensions];
   alignas(kCacheLineSize)
       WeightType weights_[kHalfDimensions * kInputDimensions];
+  // int8 weights of each feature are shifted left by this count
+  std::uint8_t weight_shifts_[kInt8Weights ? kInputDimensions : 1];
 };
 
+// Input feature converter of the default architecture
+using FeatureTransformer = BasicFeatureTransformer<DefaultArchitecture>;
+
 }  // namespace NNUE
 
 }  // namespace Eval
@@ -150,21 +150,21 @@ void PrintInfo(std::istream& stream) {
     stream >> file_name;
     if (file_name.empty()) break;
 
-    std::uint32_t hash_value;
-    std::string architecture;
+    std::uint32_t version, hash_value;
+    std::string architecture, builtin_name, builtin_architecture;
     const bool success = [&]
     {
       std::ifstream file_stream(file_name, std::ios::binary);
       if (!file_stream) return false;
-      if (!ReadHeader(file_stream, &hash_value, &architecture)) return false;
+      if (!ReadHeader(file_stream, &version, &hash_value, &architecture)) return false;
       return true;
     }();
 
     std::cout << file_name << ": ";
     if (success) {
-      if (hash_value == kHashValue) {
-        std::cout << "matches with this binary";
-        if (architecture != GetArchitectureString()) {
+      if (FindArchitecture(hash_value, &builtin_name, &builtin_architecture)) {
+        std::cout << "matches with architecture " << builtin_name << " of this binary";
+        if (architecture != builtin_architecture) {
           std::cout << ", but architecture string differs: " << architecture;
         }
         std::cout << std::endl;
@@ -109,10 +109,18 @@ IntType Round(const double value) {
   return static_cast<IntType>(std::floor(value + 0.5));
 }
 
-// make_shared with alignment
+// make_shared with alignment, large trainers like the feature transformer one get large pages
 template <typename T, typename... ArgumentTypes>
 std::shared_ptr<T> MakeAlignedSharedPtr(ArgumentTypes&&... arguments) {
-  const auto ptr = new(aligned_malloc(sizeof(T), alignof(T)))
+  PageKind kind;
+  void* const mem = aligned_large_pages_alloc(sizeof(T), &kind);
+  if (!mem) {
+    std::cout << "info string can't allocate memory. size = " << sizeof(T) << std::endl;
+    exit(1);
+  }
+  if (kind != NORMAL_PAGES)
+    std::cout << "info string Trainer allocation: " << page_kind_string(kind) << std::endl;
+  const auto ptr = new(mem)
       T(std::forward<ArgumentTypes>(arguments)...);
   return std::shared_ptr<T>(ptr, AlignedDeleter<T>());
 }
@@ -212,9 +212,8 @@ class Trainer<Layers::AffineTransform<PreviousLayer, OutputDimensions>> {
     }
     for (IndexType i = 0; i < kOutputDimensions; ++i) {
       const auto offset = kInputDimensions * i;
-      const auto padded_offset = LayerType::kPaddedInputDimensions * i;
       for (IndexType j = 0; j < kInputDimensions; ++j) {
-        target_layer_->weights_[padded_offset + j] =
+        target_layer_->weights_[LayerType::GetWeightIndex(i, j)] =
             Round<typename LayerType::WeightType>(
                 weights_[offset + j] * kWeightScale);
       }
@@ -229,10 +228,9 @@ class Trainer<Layers::AffineTransform<PreviousLayer, OutputDimensions>> {
     }
     for (IndexType i = 0; i < kOutputDimensions; ++i) {
       const auto offset = kInputDimensions * i;
-      const auto padded_offset = LayerType::kPaddedInputDimensions * i;
       for (IndexType j = 0; j < kInputDimensions; ++j) {
         weights_[offset + j] = static_cast<LearnFloatType>(
-            target_layer_->weights_[padded_offset + j] / kWeightScale);
+            target_layer_->weights_[LayerType::GetWeightIndex(i, j)] / kWeightScale);
       }
     }
     std::fill(std::begin(biases_diff_), std::end(biases_diff_),
@@ -23,10 +23,11 @@ namespace Eval {
 namespace NNUE {
 
 // Learning: Input feature converter
-template <>
-class Trainer<FeatureTransformer> {
+template <typename Architecture>
+class Trainer<BasicFeatureTransformer<Architecture>> {
 	// Type of layer to learn
-  using LayerType = FeatureTransformer;
+  using LayerType = BasicFeatureTransformer<Architecture>;
+  using RawFeatures = typename Architecture::RawFeatures;
 
  public:
   template <typename T>
@@ -179,6 +180,7 @@ class Trainer<FeatureTransformer> {
             cblas_saxpy(kHalfDimensions, -scale,
                         &gradients_[output_offset], 1,
                         &weights_[weights_offset], 1);
+            ClipWeights(weights_offset);
           }
         }
       }
@@ -211,6 +213,7 @@ class Trainer<FeatureTransformer> {
             weights_[weights_offset + i] -=
                 scale * gradients_[output_offset + i];
           }
+          ClipWeights(weights_offset);
         }
       }
     }
@@ -244,15 +247,27 @@ class Trainer<FeatureTransformer> {
     DequantizeParameters();
   }
 
+  // With int8 weights, keep the weights of a feature in the range that can be
+  // quantized, so that training sees the clipping instead of QuantizeParameters()
+  void ClipWeights(const IndexType weights_offset) {
+    if constexpr (LayerType::kInt8Weights) {
+      for (IndexType i = 0; i < kHalfDimensions; ++i) {
+        weights_[weights_offset + i] = std::clamp(weights_[weights_offset + i],
+                                                  -kMaxWeightMagnitude, +kMaxWeightMagnitude);
+      }
+    }
+  }
+
   // Weight saturation and parameterization
   void QuantizeParameters() const
   {
     for (IndexType i = 0; i < kHalfDimensions; ++i) {
       target_layer_->biases_[i] =
-          Round<LayerType::BiasType>(biases_[i] * kBiasScale);
+          Round<typename LayerType::BiasType>(biases_[i] * kBiasScale);
     }
     std::vector<TrainingFeature> training_features;
-#pragma omp parallel for private(training_features)
+    std::vector<double> column(kHalfDimensions);
+#pragma omp parallel for private(training_features) firstprivate(column)
     for (IndexType j = 0; j < RawFeatures::kDimensions; ++j) {
       training_features.clear();
       Features::Factorizer<RawFeatures>::AppendTrainingFeatures(
@@ -262,8 +277,22 @@ class Trainer<FeatureTransformer> {
         for (const auto& feature : training_features) {
           sum += weights_[kHalfDimensions * feature.GetIndex() + i];
         }
+        column[i] = std::clamp(sum * kWeightScale, -kMaxQuantizedWeight, kMaxQuantizedWeight);
+      }
+      // int8 weights: the smallest shift that fits the largest weight of the
+      // feature, so that the small ones keep as much precision as possible
+      int shift = 0;
+      if constexpr (LayerType::kInt8Weights) {
+        const double largest = std::abs(*std::max_element(column.begin(), column.end(),
+            [](const double a, const double b) { return std::abs(a) < std::abs(b); }));
+        while (shift < kMaxWeightShift && largest / (1 << shift) > kMaxWeight + 0.5) {
+          ++shift;
+        }
+        target_layer_->weight_shifts_[j] = static_cast<std::uint8_t>(shift);
+      }
+      for (IndexType i = 0; i < kHalfDimensions; ++i) {
         target_layer_->weights_[kHalfDimensions * j + i] =
-            Round<LayerType::WeightType>(sum * kWeightScale);
+            Round<typename LayerType::WeightType>(std::clamp(column[i] / (1 << shift), -kMaxWeight, kMaxWeight));
       }
     }
   }
@@ -275,7 +304,11 @@ class Trainer<FeatureTransformer> {
     }
     std::fill(std::begin(weights_), std::end(weights_), +kZero);
     for (IndexType i = 0; i < kHalfDimensions * RawFeatures::kDimensions; ++i) {
-      weights_[i] = target_layer_->weights_[i] / kWeightScale;
+      int shift = 0;
+      if constexpr (LayerType::kInt8Weights) {
+        shift = target_layer_->weight_shifts_[i / kHalfDimensions];
+      }
+      weights_[i] = target_layer_->weights_[i] * (1 << shift) / kWeightScale;
     }
     std::fill(std::begin(biases_diff_), std::end(biases_diff_), +kZero);
   }
@@ -297,8 +330,14 @@ class Trainer<FeatureTransformer> {
               << " (out of " << kInputDimensions << ") features" << std::endl;
 
     constexpr LearnFloatType kPreActivationLimit =
-        std::numeric_limits<LayerType::WeightType>::max() /
-        kWeightScale;
+        std::numeric_limits<std::int16_t>::max() / kWeightScale;
+    if constexpr (LayerType::kInt8Weights) {
+      const double mean_shift = std::accumulate(std::begin(target_layer_->weight_shifts_),
+                                                std::end(target_layer_->weight_shifts_), 0.0) /
+                                RawFeatures::kDimensions;
+      std::cout << "INFO: mean shift of the int8 weights = " << mean_shift << std::endl;
+    }
+
     std::cout << "INFO: (min, max) of pre-activations = "
               << min_pre_activation_ << ", "
               << max_pre_activation_ << " (limit = "
@@ -330,6 +369,14 @@ class Trainer<FeatureTransformer> {
   static constexpr LearnFloatType kBiasScale = kActivationScale;
   static constexpr LearnFloatType kWeightScale = kActivationScale;
 
+  // Largest quantized weight, before the shift of int8 weights, and largest
+  // weight that can be quantized
+  static constexpr double kMaxWeight = std::numeric_limits<typename LayerType::WeightType>::max();
+  static constexpr double kMaxQuantizedWeight =
+      LayerType::kInt8Weights ? kMaxWeight * (1 << kMaxWeightShift) : kMaxWeight;
+  static constexpr LearnFloatType kMaxWeightMagnitude =
+      static_cast<LearnFloatType>(kMaxQuantizedWeight / kWeightScale);
+
   // LearnFloatType constant
   static constexpr LearnFloatType kZero = static_cast<LearnFloatType>(0.0);
   static constexpr LearnFloatType kOne = static_cast<LearnFloatType>(1.0);
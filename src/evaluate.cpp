@@ -29,6 +29,7 @@
 #include "evaluate.h"
 #include "material.h"
 #include "pawns.h"
+#include "searchstats.h"
 #include "thread.h"
 #include "uci.h"
 #include "eval/nnue/evaluate_nnue.h"
@@ -882,6 +883,19 @@ namespace {
     return v;
   }
 
+  // use_classical() tells whether the hybrid evaluation should use the
+  // classical evaluation instead of NNUE: in heavily unbalanced positions, where
+  // it is accurate enough and much faster, and in known endgames.
+
+  bool use_classical(const Position& pos) {
+
+    const int imbalance =  pos.non_pawn_material(WHITE) - pos.non_pawn_material(BLACK)
+                         + (pos.count<PAWN>(WHITE) - pos.count<PAWN>(BLACK)) * PawnValueMg;
+
+    return   std::abs(imbalance) > Conf.hybridThreshold
+          || Material::probe(pos)->specialized_eval_exists();
+  }
+
 } // namespace
 
 
@@ -889,9 +903,22 @@ namespace {
 /// evaluation of the position from the point of view of the side to move.
 
 Value Eval::evaluate(const Position& pos) {
-  if (static_cast<size_t>(Options["EvalNNUE"]))
-  	return NNUE::evaluate(pos);
-  return Evaluation<NO_TRACE>(pos).value();
+
+  STATS_INC(SearchStats::EVALUATIONS);
+  STATS_TIMER(SearchStats::EVAL_TIME);
+
+  if (!Conf.evalNNUE)
+      return Evaluation<NO_TRACE>(pos).value();
+
+  if (Conf.hybridThreshold && use_classical(pos))
+  {
+      // Keep the accumulator up to date when it is cheap, so that the NNUE
+      // evaluation of the following positions is still incremental.
+      evaluate_with_no_return(pos);
+      return Evaluation<NO_TRACE>(pos).value();
+  }
+
+  return NNUE::evaluate(pos);
 }
 
 
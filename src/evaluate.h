@@ -37,6 +37,11 @@ void evaluate_with_no_return(const Position& pos);
 
 Value compute_eval(const Position& pos);
 
+#if defined(EVAL_NNUE) && defined(NNUE_PREFETCH_WEIGHTS)
+// Prefetch the NNUE weights that the evaluation after the last move will read
+void prefetch_nnue_weights(const Position& pos);
+#endif  // defined(EVAL_NNUE) && defined(NNUE_PREFETCH_WEIGHTS)
+
 #if defined(EVAL_NNUE) || defined(EVAL_LEARN)
 // Read the evaluation function file.
 // This is only called once in response to the "is_ready" command. It is not supposed to be called twice.
@@ -0,0 +1,420 @@
+﻿// Batch evaluation server
+//
+// "evalserver" command: evaluates positions in bulk for external tools, instead
+// of driving the UCI loop with "position fen" + "eval_nnue" one line at a time.
+// Positions are read in batches and spread over all the Threads, each one with
+// its own Position. Results are written as one compact line per position, in
+// input order.
+//
+// Example)
+//   evalserver mode search depth 6 input positions.fen output scores.txt
+//   evalserver mode eval format bin input teacher.bin
+//   evalserver mode qsearch socket /tmp/sf.sock
+//
+// Options
+//   mode eval|qsearch|search : static evaluation, quiescence or fixed depth search
+//   depth N                  : depth of "mode search", default 1
+//   format fen|bin           : FEN lines, or PackedSfenValue records of the gensfen format
+//   input <file>             : read positions from the file instead of stdin
+//   output <file>            : write results to the file instead of stdout
+//   socket <path>            : listen on a Unix domain socket, see serve_socket()
+//   batch N                  : positions per batch, default 4096
+//
+// Reading FEN lines stops at EOF or at a line "end". The result line is the
+// score from the side to move point of view, followed by the best move for
+// qsearch and search ("none" if there is no move), or "error" for a FEN that
+// cannot be set up. "mode eval" answers "incheck" for a side to move in check,
+// as the static evaluation is not defined there: use qsearch for these.
+
+#if defined(EVAL_LEARN)
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+
+#include "learn.h"
+#include "../evaluate.h"
+#include "../misc.h"
+#include "../movegen.h"
+#include "../position.h"
+#include "../thread.h"
+#include "../tt.h"
+#include "../uci.h"
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace Learner
+{
+	namespace {
+
+	enum class ServerMode { Eval, QSearch, Search };
+
+	struct ServerParams
+	{
+		ServerMode mode = ServerMode::Eval;
+		int depth = 1;
+		bool binary = false;
+		size_t batchSize = 4096;
+	};
+
+	// One position to evaluate, set up from a FEN or a packed sfen
+	struct Request
+	{
+		string fen;
+		PackedSfen sfen;
+		string result;
+	};
+
+	// Position::set() trusts its input, so reject at least the FENs whose board
+	// does not have one king per side, which it cannot set up.
+	bool has_kings(const string& fen)
+	{
+		const string board = fen.substr(0, fen.find(' '));
+		return count(board.begin(), board.end(), 'K') == 1 && count(board.begin(), board.end(), 'k') == 1;
+	}
+
+	// Evaluate a position set up by the calling thread. Returns the result line.
+	string evaluate_position(Position& pos, const ServerParams& params)
+	{
+		if (params.mode == ServerMode::Eval)
+			return pos.checkers() ? string("incheck") : to_string(Eval::evaluate(pos));
+
+		// Learner::search() needs at least one root move, and Learner::qsearch()
+		// scores stalemates as mates
+		if (!MoveList<LEGAL>(pos).size())
+			return to_string(pos.checkers() ? mated_in(0) : VALUE_DRAW) + " none";
+
+		const auto [value, pv] = params.mode == ServerMode::QSearch ? qsearch(pos)
+		                                                            : search(pos, params.depth);
+
+		return to_string(value) + " " + (pv.empty() ? string("none") : UCI::move(pv[0], pos.is_chess960()));
+	}
+
+	// Spread the requests among all the threads of the pool, each one picking
+	// the next request until there are none left.
+	void evaluate_batch(vector<Request>& batch, const ServerParams& params)
+	{
+		atomic<size_t> next(0);
+
+		auto worker = [&](Thread* th) {
+			Position pos;
+			StateInfo si;
+
+			for (size_t i; (i = next++) < batch.size(); )
+			{
+				Request& r = batch[i];
+
+				if (params.binary ? pos.set_from_packed_sfen(r.sfen, &si, th) != 0
+				                  : !has_kings(r.fen) || (pos.set(r.fen, false, &si, th), !pos.pos_is_ok()))
+					r.result = "error";
+				else
+					r.result = evaluate_position(pos, params);
+			}
+		};
+
+		TT.new_search();
+		Threads.stop = false;
+
+		for (Thread* th : Threads)
+			th->run_custom_job([&worker, th] { worker(th); });
+
+		for (Thread* th : Threads)
+			th->wait_for_search_finished();
+	}
+
+	// Read requests with next() until it returns false, evaluate them batch by
+	// batch and pass each result line to write(). Returns the number of positions.
+	uint64_t serve(const function<bool(Request&)>& next,
+	               const function<void(const string&)>& write,
+	               const ServerParams& params)
+	{
+		vector<Request> batch;
+		uint64_t count = 0;
+		bool more = true;
+
+		while (more)
+		{
+			batch.clear();
+			batch.reserve(params.batchSize);
+
+			while (batch.size() < params.batchSize)
+			{
+				Request r;
+				if (!(more = next(r)))
+					break;
+
+				batch.push_back(std::move(r));
+			}
+
+			if (batch.empty())
+				break;
+
+			evaluate_batch(batch, params);
+
+			string out;
+			for (const auto& r : batch)
+				out += r.result + "\n";
+
+			write(out);
+			count += batch.size();
+		}
+
+		return count;
+	}
+
+	// Request reader from a stream, FEN lines or PackedSfenValue records
+	function<bool(Request&)> stream_reader(istream& in, const ServerParams& params)
+	{
+		return [&in, params](Request& r) {
+			if (params.binary)
+			{
+				PackedSfenValue psv;
+				if (!in.read(reinterpret_cast<char*>(&psv), sizeof(psv)))
+					return false;
+
+				r.sfen = psv.sfen;
+				return true;
+			}
+
+			while (getline(in, r.fen))
+			{
+				if (!r.fen.empty() && r.fen.back() == '\r')
+					r.fen.pop_back();
+
+				if (r.fen == "end")
+					return false;
+
+				if (!r.fen.empty())
+					return true;
+			}
+
+			return false;
+		};
+	}
+
+#if !defined(_WIN32)
+
+	// Serve clients connecting to the Unix domain socket, one at a time, so
+	// that several tools share one warm engine: network and hash are loaded
+	// once. A client sends FEN lines terminated by a line "end" or by closing
+	// its write side, and receives the result lines. A client sending the line
+	// "shutdown" stops the server.
+	void serve_socket(const string& path, const ServerParams& params)
+	{
+		const int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un addr{};
+
+		addr.sun_family = AF_UNIX;
+		if (listenFd < 0 || path.size() >= sizeof(addr.sun_path))
+		{
+			sync_cout << "info string evalserver: invalid socket path " << path << sync_endl;
+			return;
+		}
+
+		path.copy(addr.sun_path, path.size());
+		unlink(path.c_str());
+
+		if (   ::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+		    || listen(listenFd, 16) < 0)
+		{
+			sync_cout << "info string evalserver: unable to listen on " << path << sync_endl;
+			close(listenFd);
+			return;
+		}
+
+		sync_cout << "info string evalserver: listening on " << path << sync_endl;
+
+		for (bool shutdown = false; !shutdown; )
+		{
+			const int fd = accept(listenFd, nullptr, nullptr);
+			if (fd < 0)
+				continue;
+
+			string buffer;
+			size_t pos = 0;
+			bool closed = false; // Set when a reply cannot be sent
+
+			// Line reader on the socket, stopping at "end", "shutdown", EOF or
+			// when the client has gone
+			auto next = [&](Request& r) {
+				while (!closed)
+				{
+					if (const size_t eol = buffer.find('\n', pos); eol != string::npos)
+					{
+						r.fen = buffer.substr(pos, eol - pos);
+						pos = eol + 1;
+
+						if (!r.fen.empty() && r.fen.back() == '\r')
+							r.fen.pop_back();
+
+						if (r.fen == "shutdown")
+							shutdown = true;
+
+						if (r.fen == "end" || r.fen == "shutdown")
+							return false;
+
+						if (!r.fen.empty())
+							return true;
+
+						continue;
+					}
+
+					buffer.erase(0, pos);
+					pos = 0;
+
+					char chunk[65536];
+					const ssize_t n = read(fd, chunk, sizeof(chunk));
+
+					if (n <= 0)
+					{
+						// Last line without a newline
+						r.fen.swap(buffer);
+						return !r.fen.empty() && r.fen != "end";
+					}
+
+					buffer.append(chunk, n);
+				}
+
+				return false;
+			};
+
+			// A client may disconnect before all its results are written: the
+			// replies are sent without SIGPIPE, that would kill the engine, and
+			// the connection is then considered closed.
+#if !defined(MSG_NOSIGNAL)
+			const int one = 1;
+			setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+			constexpr int MSG_NOSIGNAL = 0;
+#endif
+
+			auto write = [fd, &closed](const string& out) {
+				for (size_t done = 0; done < out.size() && !closed; )
+				{
+					const ssize_t n = send(fd, out.data() + done, out.size() - done, MSG_NOSIGNAL);
+					if (n < 0 && errno == EINTR)
+						continue;
+					if (n <= 0)
+						closed = true;
+					else
+						done += n;
+				}
+			};
+
+			const ServerParams fenParams = [&] { ServerParams p = params; p.binary = false; return p; }();
+			const uint64_t count = serve(next, write, fenParams);
+
+			close(fd);
+			sync_cout << "info string evalserver: client " << (closed ? "disconnected" : "served")
+			          << ", " << count << " positions" << sync_endl;
+		}
+
+		close(listenFd);
+		unlink(path.c_str());
+	}
+
+#endif
+
+	} // namespace
+
+	// "evalserver" command, see the comments at the top of this file
+	void eval_server(Position&, istringstream& is)
+	{
+		ServerParams params;
+		string token, inputFile, outputFile, socketPath;
+
+		while (is >> token)
+		{
+			if (token == "mode")
+			{
+				is >> token;
+				params.mode = token == "qsearch" ? ServerMode::QSearch
+				            : token == "search"  ? ServerMode::Search
+				                                 : ServerMode::Eval;
+			}
+			else if (token == "depth")
+				is >> params.depth;
+			else if (token == "format")
+			{
+				is >> token;
+				params.binary = token == "bin";
+			}
+			else if (token == "input")
+				is >> inputFile;
+			else if (token == "output")
+				is >> outputFile;
+			else if (token == "socket")
+				is >> socketPath;
+			else if (token == "batch")
+			{
+				is >> params.batchSize;
+				params.batchSize = max(params.batchSize, size_t(1));
+			}
+			else
+				cout << "Error! : Illegal token " << token << endl;
+		}
+
+		// Make sure the evaluation function is ready before the threads use it
+		init_nnue(true);
+
+		if (!socketPath.empty())
+		{
+#if !defined(_WIN32)
+			serve_socket(socketPath, params);
+#else
+			sync_cout << "info string evalserver: sockets are not supported on Windows" << sync_endl;
+#endif
+			return;
+		}
+
+		ifstream inputStream;
+		if (!inputFile.empty())
+		{
+			inputStream.open(inputFile, params.binary ? ios::in | ios::binary : ios::in);
+			if (!inputStream)
+			{
+				cout << "Error! : can't open " << inputFile << endl;
+				return;
+			}
+		}
+
+		ofstream outputStream;
+		if (!outputFile.empty())
+		{
+			outputStream.open(outputFile);
+			if (!outputStream)
+			{
+				cout << "Error! : can't open " << outputFile << endl;
+				return;
+			}
+		}
+
+		istream& in = inputFile.empty() ? cin : inputStream;
+		const TimePoint start = now();
+
+		const uint64_t count = serve(stream_reader(in, params),
+			[&](const string& out) {
+				if (outputFile.empty())
+					sync_cout << out << flush << IO_UNLOCK;
+				else
+					outputStream << out;
+			},
+			params);
+
+		const TimePoint elapsed = now() - start + 1;
+
+		sync_cout << "info string evalserver: " << count << " positions, "
+		          << count * 1000 / elapsed << " positions/s" << sync_endl;
+	}
+}
+
+#endif // EVAL_LEARN
@@ -60,6 +60,7 @@
 #include <unordered_set>
 #include <iomanip>
 #include <list>
+#include <memory>
 #include <cmath>	// std::exp(),std::pow(),std::log()
 #include <cstring>	// memcpy()
 
@@ -91,22 +92,6 @@ using namespace std;
 //// This is defined in the search section.
 //extern Book::BookMoveSelector book;
 
-// Addition and subtraction definition for atomic<T>
-// Aligned with atomicAdd() in Apery/learner.hpp.
-template <typename T>
-T operator += (std::atomic<T>& x, const T rhs)
-{
-	T old = x.load(std::memory_order_consume);
-	// It is allowed that the value is rewritten from other thread at this timing.
-	// The idea that the value is not destroyed is good.
-	T desired = old + rhs;
-	while (!x.compare_exchange_weak(old, desired, std::memory_order_release, std::memory_order_consume))
-		desired = old + rhs;
-	return desired;
-}
-template <typename T>
-T operator -= (std::atomic<T>& x, const T rhs) { return x += -rhs; }
-
 namespace Learner
 {
 
@@ -325,9 +310,6 @@ struct MultiThinkGenSfen final : MultiThink
 		: search_depth(search_depth_), search_depth2(search_depth2_), sw(sw_)
 	{
 		hash.resize(GENSFEN_HASH_SIZE);
-
-		// Output for confirmation if the same random seed is not drawn when parallelizing and gensfening the PC.
-		std::cout << prng << std::endl;
 	}
 
 	void thread_worker(size_t thread_id) override;
@@ -384,6 +366,9 @@ void MultiThinkGenSfen::thread_worker(size_t thread_id)
 	// For the time being, it will be treated as a draw at the maximum number of steps to write.
 	const int MAX_PLY2 = write_maxply;
 
+	// Random numbers of this thread.
+	PRNG& prng = thread_prng(thread_id);
+
 	//Maximum StateInfo + Search PV to advance to leaf buffer
 	std::vector<StateInfo,AlignedAllocator<StateInfo>> states(MAX_PLY2 + MAX_PLY /* == search_depth + α */);
 	StateInfo si;
@@ -408,6 +393,11 @@ void MultiThinkGenSfen::thread_worker(size_t thread_id)
 		auto& pos = th->rootPos;
     pos.set(StartFEN, false, &si, th);
 
+		// A private table is aged by its owner, once per game. The global one is
+		// shared by all the workers and is left alone.
+		if (th->tt != &TT)
+			th->tt->new_search();
+
     // Test cod for Packed SFEN.
     //{
     //  PackedSfen packed_sfen;
@@ -959,6 +949,12 @@ void gen_sfen(Position&, istringstream& is)
 	// Add a random number to the end of the file name.
 	bool random_file_name = false;
 
+	// Size [MB] of the transposition table of each thread. 0 : share the global TT.
+	size_t thread_hash = 0;
+
+	// Master seed of the random numbers of the threads. 0 : random.
+	uint64_t seed = 0;
+
 	while (true)
 	{
 		token = "";
@@ -1006,6 +1002,10 @@ void gen_sfen(Position&, istringstream& is)
 			is >> save_every;
 		else if (token == "random_file_name")
 			is >> random_file_name;
+		else if (token == "thread_hash")
+			is >> thread_hash;
+		else if (token == "seed")
+			is >> seed;
 		else if (token == "use_draw_in_training_data_generation")
 			is >> use_draw_in_training_data_generation;
 		else if (token == "use_game_draw_adjudication")
@@ -1062,7 +1062,9 @@ void gen_sfen(Position&, istringstream& is)
 		<< "  output_file_name       = " << output_file_name << endl
 		<< "  use_eval_hash          = " << use_eval_hash << endl
 		<< "  save_every             = " << save_every << endl
-		<< "  random_file_name       = " << random_file_name << endl;
+		<< "  random_file_name       = " << random_file_name << endl
+		<< "  thread_hash            = " << thread_hash << endl
+		<< "  seed                   = " << seed << endl;
 
 	// Create and execute threads as many as Options["Threads"].
 	{
@@ -1082,6 +1084,8 @@ void gen_sfen(Position&, istringstream& is)
 		multi_think.random_multi_pv_depth = random_multi_pv_depth;
 		multi_think.write_minply = write_minply;
 		multi_think.write_maxply = write_maxply;
+		multi_think.thread_hash_mb = thread_hash;
+		multi_think.seed = seed;
 		multi_think.start_file_write_worker();
 		multi_think.go_think();
 
@@ -1259,6 +1263,108 @@ void calc_cross_entropy(const Value deep, const Value shallow, const PackedSfenV
 		-m * std::log(m + epsilon) - (1.0 - m) * std::log(1.0 - m + epsilon);
 }
 
+// Sums of the loss terms of calc_cross_entropy() over a set of positions.
+struct LossSums
+{
+	double cross_entropy_eval = 0.0, cross_entropy_win = 0.0, cross_entropy = 0.0;
+	double entropy_eval = 0.0, entropy_win = 0.0, entropy = 0.0;
+	double norm = 0.0;
+	uint64_t count = 0;
+
+	void add(const Value deep, const Value shallow, const PackedSfenValue& psv)
+	{
+		double ce_eval, ce_win, ce, e_eval, e_win, e;
+		calc_cross_entropy(deep, shallow, psv, ce_eval, ce_win, ce, e_eval, e_win, e);
+		cross_entropy_eval += ce_eval;
+		cross_entropy_win += ce_win;
+		cross_entropy += ce;
+		entropy_eval += e_eval;
+		entropy_win += e_win;
+		entropy += e;
+		norm += static_cast<double>(abs(shallow));
+		++count;
+	}
+
+	LossSums& operator+=(const LossSums& rhs)
+	{
+		cross_entropy_eval += rhs.cross_entropy_eval;
+		cross_entropy_win += rhs.cross_entropy_win;
+		cross_entropy += rhs.cross_entropy;
+		entropy_eval += rhs.entropy_eval;
+		entropy_win += rhs.entropy_win;
+		entropy += rhs.entropy;
+		norm += rhs.norm;
+		count += rhs.count;
+		return *this;
+	}
+
+	LossSums operator-(const LossSums& rhs) const
+	{
+		LossSums d = *this;
+		d.cross_entropy_eval -= rhs.cross_entropy_eval;
+		d.cross_entropy_win -= rhs.cross_entropy_win;
+		d.cross_entropy -= rhs.cross_entropy;
+		d.entropy_eval -= rhs.entropy_eval;
+		d.entropy_win -= rhs.entropy_win;
+		d.entropy -= rhs.entropy;
+		d.norm -= rhs.norm;
+		d.count -= rhs.count;
+		return d;
+	}
+};
+
+// LossSums of one thread, alone on its cache line. Only the owner thread adds to it, so a relaxed
+// load and store replace the compare_exchange loop of a shared atomic<double>, and another thread
+// may read it at any time. The sums are never reset: the reader keeps the previous totals instead.
+struct alignas(64) ThreadLossSums
+{
+	std::atomic<double> cross_entropy_eval{}, cross_entropy_win{}, cross_entropy{};
+	std::atomic<double> entropy_eval{}, entropy_win{}, entropy{};
+	std::atomic<double> norm{};
+	std::atomic<uint64_t> count{};
+
+	void add(const Value deep, const Value shallow, const PackedSfenValue& psv)
+	{
+		LossSums s;
+		s.add(deep, shallow, psv);
+		add(cross_entropy_eval, s.cross_entropy_eval);
+		add(cross_entropy_win, s.cross_entropy_win);
+		add(cross_entropy, s.cross_entropy);
+		add(entropy_eval, s.entropy_eval);
+		add(entropy_win, s.entropy_win);
+		add(entropy, s.entropy);
+		add(norm, s.norm);
+		add(count, s.count);
+	}
+
+	[[nodiscard]] LossSums load() const
+	{
+		LossSums s;
+		s.cross_entropy_eval = cross_entropy_eval.load(std::memory_order_relaxed);
+		s.cross_entropy_win = cross_entropy_win.load(std::memory_order_relaxed);
+		s.cross_entropy = cross_entropy.load(std::memory_order_relaxed);
+		s.entropy_eval = entropy_eval.load(std::memory_order_relaxed);
+		s.entropy_win = entropy_win.load(std::memory_order_relaxed);
+		s.entropy = entropy.load(std::memory_order_relaxed);
+		s.norm = norm.load(std::memory_order_relaxed);
+		s.count = count.load(std::memory_order_relaxed);
+		return s;
+	}
+
+private:
+	template <typename T>
+	static void add(std::atomic<T>& x, const T v) { x.store(x.load(std::memory_order_relaxed) + v, std::memory_order_relaxed); }
+};
+
+// Sum of the LossSums of the first thread_num threads.
+LossSums sum_loss(const ThreadLossSums* sums, const size_t thread_num)
+{
+	LossSums total;
+	for (size_t i = 0; i < thread_num; ++i)
+		total += sums[i].load();
+	return total;
+}
+
 #endif
 
 
@@ -1529,7 +1635,8 @@ struct SfenReader
 	uint64_t last_done;
 
 	// If total_read exceeds this value, update_weights() and calculate mse.
-	uint64_t next_update_weights;
+	// Written by thread 0 only, read by the threads waiting for the update.
+	atomic<uint64_t> next_update_weights;
 
 	uint64_t save_count;
 
@@ -1588,16 +1695,8 @@ protected:
 // Class to generate sfen with multiple threads
 struct LearnerThink final : MultiThink
 {
-	explicit LearnerThink(SfenReader& sr_):sr(sr_),stop_flag(false), save_only_once(false), learn_sum_cross_entropy_eval(0.0)
+	explicit LearnerThink(SfenReader& sr_):sr(sr_),stop_flag(false), save_only_once(false)
 	{
-#if defined ( LOSS_FUNCTION_IS_ELMO_METHOD )
-
-		learn_sum_cross_entropy_win = 0.0;
-		learn_sum_cross_entropy = 0.0;
-		learn_sum_entropy_eval = 0.0;
-		learn_sum_entropy_win = 0.0;
-		learn_sum_entropy = 0.0;
-#endif
 #if defined(EVAL_NNUE)
 		newbob_scale = 1.0;
 		newbob_decay = 1.0;
@@ -1608,6 +1707,7 @@ struct LearnerThink final : MultiThink
 #endif
 	}
 
+	void init() override;
 	void thread_worker(size_t thread_id) override;
 
 	// Start a thread that loads the phase file in the background.
@@ -1625,7 +1725,8 @@ struct LearnerThink final : MultiThink
 	// Mini batch size size. Be sure to set it on the side that uses this class.
 	uint64_t mini_batch_size = 1000*1000;
 
-	bool stop_flag;
+	// Set by the thread that ends the learning. The threads waiting for an update check it.
+	atomic<bool> stop_flag;
 
 	// Discount rate
 	double discount_rate{};
@@ -1645,14 +1746,21 @@ struct LearnerThink final : MultiThink
 
 	// --- loss calculation
 
+	size_t thread_num = 0;
+
+	// Number of positions a thread processes between two additions to sr.total_done.
+	// Near the end of a mini-batch every position is added, so that the batch is
+	// exceeded by at most the position in progress in each thread.
+	static constexpr uint64_t DoneFlushInterval = 64;
+
 #if defined (LOSS_FUNCTION_IS_ELMO_METHOD)
-	// For calculation of learning data loss
-	atomic<double> learn_sum_cross_entropy_eval;
-	atomic<double> learn_sum_cross_entropy_win;
-	atomic<double> learn_sum_cross_entropy;
-	atomic<double> learn_sum_entropy_eval;
-	atomic<double> learn_sum_entropy_win;
-	atomic<double> learn_sum_entropy;
+	// Loss of the training data, summed by each thread. calc_loss() reports the part
+	// added since learn_loss_reported, the totals at its previous call.
+	std::unique_ptr<ThreadLossSums[]> learn_loss;
+	LossSums learn_loss_reported;
+
+	// Loss of the validation data, summed by each thread during calc_loss().
+	std::unique_ptr<ThreadLossSums[]> test_loss;
 #endif
 
 #if defined(EVAL_NNUE)
@@ -1674,10 +1782,19 @@ struct LearnerThink final : MultiThink
 	// done: Number of phases targeted this time
 	void calc_loss(size_t thread_id , uint64_t done);
 
-	// Define the loss calculation in ↑ as a task and execute it
-	TaskDispatcher task_dispatcher;
 };
 
+void LearnerThink::init()
+{
+	thread_num = static_cast<size_t>(Options["Threads"]);
+
+#if defined (LOSS_FUNCTION_IS_ELMO_METHOD)
+	learn_loss = std::make_unique<ThreadLossSums[]>(thread_num);
+	learn_loss_reported = LossSums();
+	test_loss = std::make_unique<ThreadLossSums[]>(thread_num);
+#endif
+}
+
 void LearnerThink::calc_loss(const size_t thread_id, const uint64_t done)
 {
 	// There is no point in hitting the replacement table, so at this timing the generation of the replacement table is updated.
@@ -1699,14 +1816,8 @@ void LearnerThink::calc_loss(const size_t thread_id, const uint64_t done)
 #endif
 
 #if defined (LOSS_FUNCTION_IS_ELMO_METHOD)
-	atomic<double> test_sum_cross_entropy_eval = 0;
-	atomic<double> test_sum_cross_entropy_win = 0;
-	atomic<double> test_sum_cross_entropy = 0;
-	atomic<double> test_sum_entropy_eval = 0;
-	atomic<double> test_sum_entropy_win = 0;
-	atomic<double> test_sum_entropy = 0;
-
-	atomic<double> sum_norm = 0;
+	// Start the validation sums from zero. No task is running at this point.
+	test_loss = std::make_unique<ThreadLossSums[]>(thread_num);
 #endif
 
 	atomic move_accord_count = 0;
@@ -1720,19 +1831,15 @@ void LearnerThink::calc_loss(const size_t thread_id, const uint64_t done)
 
 	//Eval::print_eval_stat(pos);
 
-	// It's better to parallelize here, but it's a bit troublesome because the search before slave has not finished.
-	// I created a mechanism to call task, so I will use it.
-
-	atomic task_count = static_cast<int>(sr.sfen_for_mse.size());
-	task_dispatcher.task_reserve(task_count);
+	// The other threads are waiting for the update of the weights in task_pool, they run these tasks meanwhile.
 
 	// Create a task to search for the situation and give it to each thread.
 	for (const auto& ps : sr.sfen_for_mse)
 	{
-		// Assign work to each thread using TaskDispatcher.
+		// Assign work to each thread using TaskPool.
 		// A task definition for that.
 		// It is not possible to capture pos used in ↑, so specify the variables you want to capture one by one.
-		auto task = [&ps,&test_sum_cross_entropy_eval,&test_sum_cross_entropy_win,&test_sum_cross_entropy,&test_sum_entropy_eval,&test_sum_entropy_win,&test_sum_entropy, &sum_norm,&task_count ,&move_accord_count](const size_t thread_id)
+		auto task = [this, &ps, &move_accord_count](const size_t thread_id)
 		{
 			// Does C++ properly capture a new ps instance for each loop?.
 			const auto th = Threads[thread_id];
@@ -1789,17 +1896,8 @@ void LearnerThink::calc_loss(const size_t thread_id, const uint64_t done)
 			// Calculate and display the cross entropy.
 
 #if defined (LOSS_FUNCTION_IS_ELMO_METHOD)
-			double test_cross_entropy_eval, test_cross_entropy_win, test_cross_entropy;
-			double test_entropy_eval, test_entropy_win, test_entropy;
-			calc_cross_entropy(deep_value, shallow_value, ps, test_cross_entropy_eval, test_cross_entropy_win, test_cross_entropy, test_entropy_eval, test_entropy_win, test_entropy);
 			// The total cross entropy need not be abs() by definition.
-			test_sum_cross_entropy_eval += test_cross_entropy_eval;
-			test_sum_cross_entropy_win += test_cross_entropy_win;
-			test_sum_cross_entropy += test_cross_entropy;
-			test_sum_entropy_eval += test_entropy_eval;
-			test_sum_entropy_win += test_entropy_win;
-			test_sum_entropy += test_entropy;
-			sum_norm += static_cast<double>(abs(shallow_value));
+			test_loss[thread_id].add(deep_value, shallow_value, ps);
 #endif
 
 			// Determine if the teacher's move and the score of the shallow search match
@@ -1808,21 +1906,14 @@ void LearnerThink::calc_loss(const size_t thread_id, const uint64_t done)
 				if (static_cast<uint16_t>(snd[0]) == ps.move)
 					move_accord_count.fetch_add(1, std::memory_order_relaxed);
 			}
-
-			// Reduced one task because I did it
-			--task_count;
 		};
 
-		// Throw the defined task to slave.
-		task_dispatcher.push_task_async(task);
+		// Queue the task on our deque, the idle threads steal from it.
+		task_pool.push(thread_id, task);
 	}
 
-	// join yourself as a slave
-	task_dispatcher.on_idle(thread_id);
-
-	// wait for all tasks to complete
-	while (task_count)
-		sleep(1);
+	// join yourself as a slave, until all tasks are complete
+	task_pool.wait_all(thread_id);
 
 #if !defined(LOSS_FUNCTION_IS_ELMO_METHOD)
 	// rmse = root mean square error: mean square error
@@ -1835,8 +1926,17 @@ void LearnerThink::calc_loss(const size_t thread_id, const uint64_t done)
 #endif
 
 #if defined ( LOSS_FUNCTION_IS_ELMO_METHOD )
+	// All the tasks are done, so the validation sums are complete.
+	const LossSums test = sum_loss(test_loss.get(), thread_num);
+
+	// The training sums since the previous report. A thread may still be adding the
+	// position it started before the update, it then counts in the next report.
+	const LossSums learn_total = sum_loss(learn_loss.get(), thread_num);
+	const LossSums learn = learn_total - learn_loss_reported;
+	learn_loss_reported = learn_total;
+
 #if defined(EVAL_NNUE)
-	latest_loss_sum += test_sum_cross_entropy - test_sum_entropy;
+	latest_loss_sum += test.cross_entropy - test.entropy;
 	latest_loss_count += sr.sfen_for_mse.size();
 #endif
 
@@ -1846,37 +1946,30 @@ void LearnerThink::calc_loss(const size_t thread_id, const uint64_t done)
 	if (!sr.sfen_for_mse.empty() && done)
 	{
 		cout
-			<< " , test_cross_entropy_eval = "  << test_sum_cross_entropy_eval / sr.sfen_for_mse.size()
-			<< " , test_cross_entropy_win = "   << test_sum_cross_entropy_win / sr.sfen_for_mse.size()
-			<< " , test_entropy_eval = "        << test_sum_entropy_eval / sr.sfen_for_mse.size()
-			<< " , test_entropy_win = "         << test_sum_entropy_win / sr.sfen_for_mse.size()
-			<< " , test_cross_entropy = "       << test_sum_cross_entropy / sr.sfen_for_mse.size()
-			<< " , test_entropy = "             << test_sum_entropy / sr.sfen_for_mse.size()
-			<< " , norm = "						<< sum_norm
+			<< " , test_cross_entropy_eval = "  << test.cross_entropy_eval / sr.sfen_for_mse.size()
+			<< " , test_cross_entropy_win = "   << test.cross_entropy_win / sr.sfen_for_mse.size()
+			<< " , test_entropy_eval = "        << test.entropy_eval / sr.sfen_for_mse.size()
+			<< " , test_entropy_win = "         << test.entropy_win / sr.sfen_for_mse.size()
+			<< " , test_cross_entropy = "       << test.cross_entropy / sr.sfen_for_mse.size()
+			<< " , test_entropy = "             << test.entropy / sr.sfen_for_mse.size()
+			<< " , norm = "						<< test.norm
 			<< " , move accuracy = "			<< move_accord_count * 100.0 / sr.sfen_for_mse.size() << "%";
-		if (done != static_cast<uint64_t>(-1))
+		if (done != static_cast<uint64_t>(-1) && learn.count)
 		{
+			const auto n = static_cast<double>(learn.count);
 			cout
-				<< " , learn_cross_entropy_eval = " << learn_sum_cross_entropy_eval / static_cast<double>(done)
-				<< " , learn_cross_entropy_win = "  << learn_sum_cross_entropy_win / static_cast<double>(done)
-				<< " , learn_entropy_eval = "       << learn_sum_entropy_eval / static_cast<double>(done)
-				<< " , learn_entropy_win = "        << learn_sum_entropy_win / static_cast<double>(done)
-				<< " , learn_cross_entropy = "      << learn_sum_cross_entropy / static_cast<double>(done)
-				<< " , learn_entropy = "            << learn_sum_entropy / static_cast<double>(done);
+				<< " , learn_cross_entropy_eval = " << learn.cross_entropy_eval / n
+				<< " , learn_cross_entropy_win = "  << learn.cross_entropy_win / n
+				<< " , learn_entropy_eval = "       << learn.entropy_eval / n
+				<< " , learn_entropy_win = "        << learn.entropy_win / n
+				<< " , learn_cross_entropy = "      << learn.cross_entropy / n
+				<< " , learn_entropy = "            << learn.entropy / n;
 		}
 		cout << endl;
 	}
 	else {
 		cout << "Error! : sr.sfen_for_mse.size() = " << sr.sfen_for_mse.size() << " ,  done = " << done << endl;
 	}
-
-	// Clear 0 for next time.
-	learn_sum_cross_entropy_eval = 0.0;
-	learn_sum_cross_entropy_win = 0.0;
-	learn_sum_cross_entropy = 0.0;
-	learn_sum_entropy_eval = 0.0;
-	learn_sum_entropy_win = 0.0;
-	learn_sum_entropy = 0.0;
 #else
 	<< endl;
 #endif
@@ -1887,11 +1980,26 @@ void LearnerThink::thread_worker(const size_t thread_id)
 {
 #if defined(_OPENMP)
 	omp_set_num_threads((int)Options["Threads"]);
+
+	// The OpenMP team of thread 0 runs the parameter update. Bind its helper
+	// threads like the search threads, the master being already bound.
+	if (thread_id == 0)
+	{
+#pragma omp parallel
+		if (omp_get_thread_num())
+			WinProcGroup::bindThisThread(omp_get_thread_num());
+	}
 #endif
 
 	const auto th = Threads[thread_id];
 	auto& pos = th->rootPos;
 
+	// Random numbers of this thread.
+	PRNG& prng = thread_prng(thread_id);
+
+	// Positions processed by this thread and not yet added to sr.total_done.
+	uint64_t pending_done = 0;
+
 	while (true)
 	{
 	// display mse (this is sometimes done only for thread 0)
@@ -1912,8 +2020,9 @@ void LearnerThink::thread_worker(const size_t thread_id)
 				if (stop_flag)
 					break;
 
-				// I want to parallelize rmse calculation etc., so if task() is loaded, process it.
-				task_dispatcher.on_idle(thread_id);
+				// I want to parallelize rmse calculation etc., so run the tasks of task_pool until the update is done.
+				// Thread 0 notifies task_pool when it is.
+				task_pool.work_until(thread_id, [&] { return stop_flag || sr.next_update_weights > sr.total_done; });
 				continue;
 			}
 			// Only thread_id == 0 performs the following update process.
@@ -1922,6 +2031,7 @@ void LearnerThink::thread_worker(const size_t thread_id)
 			if (sr.next_update_weights == 0)
 			{
 				sr.next_update_weights += mini_batch_size;
+				task_pool.notify();
 				continue;
 			}
 
@@ -1957,6 +2067,7 @@ void LearnerThink::thread_worker(const size_t thread_id)
 				{
 					stop_flag = true;
 					sr.stop_flag = true;
+					task_pool.notify();
 					break;
 				}
 			}
@@ -1987,6 +2098,7 @@ void LearnerThink::thread_worker(const size_t thread_id)
 
 			// Since I was waiting for the update of this sr.next_update_weights except the main thread,
 			// Once this value is updated, it will start moving again.
+			task_pool.notify();
 		}
 
 		PackedSfenValue ps{};
@@ -1998,6 +2110,7 @@ void LearnerThink::thread_worker(const size_t thread_id)
 			// Terminate all other threads.
 
 			stop_flag = true;
+			task_pool.notify();
 			break;
 		}
 
@@ -2105,15 +2218,7 @@ void LearnerThink::thread_worker(const size_t thread_id)
 
 #if defined (LOSS_FUNCTION_IS_ELMO_METHOD)
 			// Calculate loss for training data
-			double learn_cross_entropy_eval, learn_cross_entropy_win, learn_cross_entropy;
-			double learn_entropy_eval, learn_entropy_win, learn_entropy;
-			calc_cross_entropy(deep_value, shallow_value, ps, learn_cross_entropy_eval, learn_cross_entropy_win, learn_cross_entropy, learn_entropy_eval, learn_entropy_win, learn_entropy);
-			learn_sum_cross_entropy_eval += learn_cross_entropy_eval;
-			learn_sum_cross_entropy_win += learn_cross_entropy_win;
-			learn_sum_cross_entropy += learn_cross_entropy;
-			learn_sum_entropy_eval += learn_entropy_eval;
-			learn_sum_entropy_win += learn_entropy_win;
-			learn_sum_entropy += learn_entropy;
+			learn_loss[thread_id].add(deep_value, shallow_value, ps);
 #endif
 
 #if !defined(EVAL_NNUE)
@@ -2135,8 +2240,15 @@ void LearnerThink::thread_worker(const size_t thread_id)
 			Eval::NNUE::AddExample(pos, rootColor, ps, example_weight);
 #endif
 
-			// Since the processing is completed, the counter of the processed number is incremented
-			++sr.total_done;
+			// Since the processing is completed, the counter of the processed number is incremented.
+			// It is shared by all the threads, so add to it only every DoneFlushInterval positions,
+			// until the positions not yet added by all the threads could complete the mini-batch.
+			if (   ++pending_done == DoneFlushInterval
+			    || sr.total_done + DoneFlushInterval * thread_num >= sr.next_update_weights)
+			{
+				sr.total_done += pending_done;
+				pending_done = 0;
+			}
 		};
 
 	bool illegal_move = false;
@@ -2185,6 +2297,7 @@ void LearnerThink::thread_worker(const size_t thread_id)
 
 	}
 
+	sr.total_done += pending_done;
 }
 
 // Write evaluation function file.
@@ -2935,6 +3048,7 @@ void learn(Position&, istringstream& is)
 	uint64_t eval_save_interval = LEARN_EVAL_SAVE_INTERVAL;
 	uint64_t loss_output_interval = 0;
 	uint64_t mirror_percentage = 0;
+	uint64_t seed = 0;
 
 	string validation_set_file_name;
 
@@ -3021,6 +3135,7 @@ void learn(Position&, istringstream& is)
 		else if (option == "eval_save_interval") is >> eval_save_interval;
 		else if (option == "loss_output_interval") is >> loss_output_interval;
 		else if (option == "mirror_percentage") is >> mirror_percentage;
+		else if (option == "seed") is >> seed;
 		else if (option == "validation_set_file_name") is >> validation_set_file_name;
 
 		// Rabbit convert related
@@ -3194,6 +3309,7 @@ void learn(Position&, istringstream& is)
 	cout << "LAMBDA_LIMIT      : " << ELMO_LAMBDA_LIMIT << endl;
 #endif
 	cout << "mirror_percentage : " << mirror_percentage << endl;
+	cout << "seed              : " << seed << endl;
 	cout << "eval_save_interval  : " << eval_save_interval << " sfens" << endl;
 	cout << "loss_output_interval: " << loss_output_interval << " sfens" << endl;
 
@@ -3258,6 +3374,7 @@ void learn(Position&, istringstream& is)
 	learn_think.eval_save_interval = eval_save_interval;
 	learn_think.loss_output_interval = loss_output_interval;
 	learn_think.mirror_percentage = mirror_percentage;
+	learn_think.seed = seed;
 
 	// Start a thread that loads the phase file in the background
 	// (If this is not started, mse cannot be calculated.)
@@ -7,6 +7,8 @@
 #endif
 #include "../misc.h"
 
+#include <mutex>
+
 using namespace Eval;
 
 namespace EvalLearningTools
@@ -224,9 +226,10 @@ namespace EvalLearningTools
 	// Initialize this entire EvalLearningTools
 	void init()
 	{
-		// Initialization is required only once after startup, so a flag for that.
-
-		if (auto first = true)
+		// Initialization is required only once after startup, and the first caller does it.
+		// The NNUE learner does not use these tables, so the engine never pays for them at startup.
+		static std::once_flag once;
+		std::call_once(once, []
 		{
 			std::cout << "EvalLearningTools init..";
 
@@ -245,9 +248,7 @@ namespace EvalLearningTools
 			init_min_index_flag();
 
 			std::cout << "done." << std::endl;
-
-			first = false;
-		}
+		});
 	}
 }
 
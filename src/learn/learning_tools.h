@@ -22,7 +22,8 @@ namespace EvalLearningTools
 	// -------------------------------------------------
 
 	// Initialize the tables in this EvalLearningTools namespace.
-	// Be sure to call once before learning starts.
+	// Be sure to call before learning starts with an evaluation function that uses min_index_flag.
+	// Only the first call builds the tables, the others return at once.
 	// In this function, we also call init_mir_inv_tables().
 	// (It is not necessary to call init_mir_inv_tables() when calling this function.)
 	void init();
@@ -1,10 +1,14 @@
 ﻿#if defined(EVAL_LEARN)
 
 #include "multi_think.h"
+#include "../thread.h"
 #include "../tt.h"
 #include "../uci.h"
 
-#include <thread>
+#include <cassert>
+#include <chrono>
+#include <memory>
+#include <random>
 
 void MultiThink::go_think()
 {
@@ -27,73 +31,59 @@ void MultiThink::go_think()
 	loop_count = 0;
 	done_count = 0;
 
-	// Create threads as many as Options["Threads"] and start thinking.
-	std::vector<std::thread> threads;
+	// Start thinking with the threads of the search thread pool, as many as Options["Threads"].
 	const auto thread_num = static_cast<size_t>(Options["Threads"]);
+	assert(Threads.size() == thread_num);
+
+	// Seed the random number generator of each worker thread.
+	if (!seed)
+		seed = static_cast<uint64_t>(std::random_device()()) << 32 | std::random_device()();
+	std::cout << "PRNG::seed = " << seed << std::endl;
+
+	prngs.clear();
+	for (size_t i = 0; i < thread_num; ++i)
+		prngs.push_back({ PRNG(prng_stream_seed(seed, i)) });
+
+	task_pool.resize(thread_num);
+	running_threads = thread_num;
 
-	// Secure end flag of worker thread
-	thread_finished.resize(thread_num);
-	
 	// start worker thread
 	for (size_t i = 0; i < thread_num; ++i)
 	{
-		thread_finished[i] = 0;
-		threads.emplace_back([i, this]
-		{ 
-			// exhaust all processor threads.
-			WinProcGroup::bindThisThread(i);
+		// The thread has been bound to its processor when it was created.
+		Threads[i]->run_custom_job([i, this]
+		{
+			// Allocate the private table in the thread, so that its pages are local to it.
+			std::unique_ptr<TranspositionTable> tt;
+			if (thread_hash_mb)
+			{
+				tt = std::make_unique<TranspositionTable>();
+				tt->resize(thread_hash_mb, true);
+				Threads[i]->tt = tt.get();
+			}
 
 			// execute the overridden process
 			this->thread_worker(i);
 
-			// Set the end flag because the thread has ended
-			this->thread_finished[i] = 1;
+			Threads[i]->tt = &TT;
+
+			// Wake up the master if this was the last worker.
+			std::lock_guard lk(finished_mutex);
+			if (--running_threads == 0)
+				finished_cv.notify_one();
 		});
 	}
 
-	// wait for all threads to finish
-	// for (auto& th :threads)
-	// th.join();
-	// If you write like, the thread will rush here while it is still working,
-	// During that time, callback_func() cannot be called and you cannot save.
-	// Therefore, you need to check the end flag yourself.
-
-	// function to determine if all threads have finished
-	auto threads_done = [&]
+	// Wait for all the workers to finish, calling callback_func() every callback_seconds.
+	// The interval starts after the callback returns, so a long save() in it does not shorten the next one.
 	{
-		// returns false if no one is finished
-		for (const auto& f : thread_finished)
+		std::unique_lock lk(finished_mutex);
+		while (!finished_cv.wait_for(lk, std::chrono::seconds(callback_seconds), [&] { return running_threads == 0; }))
 		{
-			if (!f)
-				return false;
-		}
-		return true;
-	};
-
-	// Call back if the callback function is set.
-	auto do_a_callback = [&]
-	{
-		if (callback_func)
-			callback_func();
-	};
-
-
-	for (uint64_t i = 0 ; ; )
-	{
-		// If all threads have finished, exit the loop.
-		if (threads_done())
-			break;
-
-		sleep(1000);
-
-		// callback_func() is called every callback_seconds.
-		if (++i == callback_seconds)
-		{
-			do_a_callback();
-			// Since I am returning from ↑, I reset the counter, so
-			// no matter how long it takes to save() etc. in do_a_callback()
-			// The next call will take a certain amount of time.
-			i = 0;
+			lk.unlock();
+			if (callback_func)
+				callback_func();
+			lk.lock();
 		}
 	}
 
@@ -103,10 +93,9 @@ void MultiThink::go_think()
 	// do_a_callback();
 	// → It should be saved by the caller, so I feel that it is not necessary here.
 
-	// It is possible that the exit code of the thread is running but the exit code of the thread is running, so
-	// We need to wait for the end with join().
-	for (auto& th : threads)
-		th.join();
+	// A worker may still be returning from its job, wait until all the threads are idle again.
+	for (size_t i = 0; i < thread_num; ++i)
+		Threads[i]->wait_for_search_finished();
 
 	// The file writing thread etc. are still running only when all threads are finished
 	// Since the work itself may not have completed, output only that all threads have finished.
@@ -119,5 +108,90 @@ void MultiThink::go_think()
 
 }
 
+void TaskPool::resize(const size_t thread_num)
+{
+	assert(queued == 0);
+
+	queues = std::make_unique<Queue[]>(thread_num);
+	queue_count = thread_num;
+}
+
+void TaskPool::push(const size_t thread_id, Task task)
+{
+	// Count the task before it can be taken, so that the counters never go below zero.
+	++pending;
+	++queued;
+	{
+		std::lock_guard lk(queues[thread_id].mutex);
+		queues[thread_id].tasks.push_back(std::move(task));
+	}
+
+	// A thread that parks after this point sees queued > 0 and does not wait.
+	if (parked)
+	{
+		{ std::lock_guard lk(mutex); }
+		cv.notify_one();
+	}
+}
+
+void TaskPool::notify()
+{
+	{ std::lock_guard lk(mutex); }
+	cv.notify_all();
+}
+
+bool TaskPool::run_one(const size_t thread_id)
+{
+	Task task;
+
+	// The own deque first, at the back, where the most recent tasks are.
+	// Then steal from the front of the others, the oldest tasks.
+	for (size_t i = 0; i < queue_count && !task; ++i)
+	{
+		Queue& q = queues[(thread_id + i) % queue_count];
+		std::lock_guard lk(q.mutex);
+
+		if (q.tasks.empty())
+			continue;
+
+		if (i == 0)
+		{
+			task = std::move(q.tasks.back());
+			q.tasks.pop_back();
+		}
+		else
+		{
+			task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+		}
+		--queued;
+	}
+
+	if (!task)
+		return false;
+
+	task(thread_id);
+
+	// Wake up the threads in wait_all() at the end of the last task.
+	if (--pending == 0)
+		notify();
+
+	return true;
+}
+
+void TaskPool::work_until(const size_t thread_id, const std::function<bool()>& done)
+{
+	while (!done())
+	{
+		if (run_one(thread_id))
+			continue;
+
+		std::unique_lock lk(mutex);
+		++parked;
+		cv.wait(lk, [&] { return queued > 0 || done(); });
+		--parked;
+	}
+}
+
 
 #endif // defined(EVAL_LEARN)
@@ -3,7 +3,10 @@
 
 #if defined(EVAL_LEARN)
 
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <memory>
 #include <random>
 
 #include "../misc.h"
@@ -12,19 +15,64 @@
 
 #include <atomic>
 
+// Work-stealing pool of tasks, run by the worker threads themselves while they wait for something.
+// Each worker owns a deque: it pushes and pops its own tasks at the back, and an idle worker steals
+// from the front of the deques of the others. A worker that finds no task parks on a condition variable
+// until a task is pushed or notify() tells that the condition it waits for may have changed.
+class TaskPool
+{
+public:
+	typedef std::function<void(size_t /* thread_id */)> Task;
+
+	// Set the number of worker threads. Must not be called while a task is queued.
+	void resize(size_t thread_num);
+
+	// [ASYNC] Queue a task on the deque of thread_id.
+	void push(size_t thread_id, Task task);
+
+	// [ASYNC] Run tasks until done() returns true, parking while there is none.
+	// The thread that makes done() true must call notify() afterwards, except when it is the end of the last task.
+	void work_until(size_t thread_id, const std::function<bool()>& done);
+
+	// [ASYNC] Run tasks until all the pushed tasks are finished.
+	void wait_all(const size_t thread_id) { work_until(thread_id, [&] { return pending == 0; }); }
+
+	// [ASYNC] Wake up the parked threads so that they check their condition again.
+	void notify();
+
+private:
+	// Pop a task from the own deque or steal one, and run it. Return false if there was none.
+	bool run_one(size_t thread_id);
+
+	struct alignas(64) Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::unique_ptr<Queue[]> queues;
+	size_t queue_count = 0;
+
+	// Number of tasks in the deques, of tasks pushed and not finished yet, and of parked threads.
+	std::atomic<size_t> queued{0}, pending{0}, parked{0};
+
+	std::mutex mutex;
+	std::condition_variable cv;
+};
+
 // Learning from a game record, when making yourself think and generating a fixed track, etc.
 // Helper class used when multiple threads want to call Search::think() individually.
 // Derive and use this class.
 struct MultiThink
 {
 	virtual ~MultiThink() = default;
-	std::random_device seed_it;
-    MultiThink() : prng(seed_it()), loop_count(0) //21120903
+    MultiThink() : loop_count(0)
 	{
 	}
 
 	// Call this function from the master thread, each thread will think,
 	// Return control when the thought ending condition is satisfied.
+	// The workers are run by the threads of the search thread pool (Threads), so no thread is created.
 	// Do something else.
 	// ・It is safe for each thread to call Learner::search(),qsearch()
 	// Separates the substitution table for each thread. (It will be restored after the end.)
@@ -46,6 +94,15 @@ struct MultiThink
 	// Override and use this.
 	virtual void thread_worker(size_t thread_id) = 0;
 
+	// Master seed of the random number generators. 0 : draw one from std::random_device in go_think().
+	// Each worker thread has its own stream derived from it, so a run can be reproduced thread by thread.
+	uint64_t seed = 0;
+
+	// Size [MB] of a transposition table private to each worker thread.
+	// 0 : the workers share the global TT. Fixed low depth searches need only a small table,
+	// and one that fits in the cache of the core avoids the contention between the threads.
+	size_t thread_hash_mb = 0;
+
 	// Called back every callback_seconds [seconds] when go_think().
 	std::function<void()> callback_func;
 	uint64_t callback_seconds = 600;
@@ -77,10 +134,17 @@ struct MultiThink
 	std::mutex io_mutex;
 
 protected:
-	// Random number generator body
-	AsyncPRNG prng;
+	// Random number generator of the worker thread thread_id. Only that thread may use it.
+	PRNG& thread_prng(const size_t thread_id) { return prngs[thread_id].prng; }
+
+	// Tasks shared by the worker threads, sized by go_think().
+	TaskPool task_pool;
 
 private:
+	// One generator per worker thread, each on its own cache line.
+	struct alignas(64) ThreadPRNG { PRNG prng; };
+	std::vector<ThreadPRNG> prngs;
+
 	// number of times worker processes (calls Search::think())
 	std::atomic<uint64_t> loop_max;
 	// number of times the worker has processed (calls Search::think())
@@ -91,61 +155,10 @@ private:
 	// Mutex when changing the variables in ↑
 	std::mutex loop_mutex;
 
-	// Thread end flag.
-	// vector<bool> may not be reflected properly when trying to rewrite from multiple threads...
-	typedef uint8_t Flag;
-	std::vector<Flag> thread_finished;
-
-};
-
-// Mechanism to process task during idle time.
-// master passes the task with push_task_async() whenever you like.
-// When slave executes on_idle() in its spare time, it retrieves one task and continues execution until there is no queue.
-// Convenient to use when you want to write MultiThink thread worker in master-slave method.
-struct TaskDispatcher
-{
-	typedef std::function<void(size_t /* thread_id */)> Task;
-
-	// slave calls this function during idle.
-	void on_idle(const size_t thread_id)
-	{
-		Task task;
-		while ((task = get_task_async()) != nullptr)
-			task(thread_id);
-
-		sleep(1);
-	}
-
-	// Stack [ASYNC] task.
-	void push_task_async(const Task& task)
-	{
-		std::unique_lock lk(task_mutex);
-		tasks.push_back(task);
-	}
-
-	// Allocate size array elements for task in advance.
-	void task_reserve(const size_t size)
-	{
-		tasks.reserve(size);
-	}
-
-protected:
-	// set of tasks
-	std::vector<Task> tasks;
-
-	// Take out one [ASYNC] task. Called from on_idle().
-	Task get_task_async()
-	{
-		std::unique_lock lk(task_mutex);
-		if (tasks.empty())
-			return nullptr;
-		Task task = *tasks.rbegin();
-		tasks.pop_back();
-		return task;
-	}
-
-	// a mutex for accessing tasks
-	std::mutex task_mutex;
+	// Number of worker threads still running, the master waits on finished_cv.
+	size_t running_threads = 0;
+	std::mutex finished_mutex;
+	std::condition_variable finished_cv;
 };
 
 #endif // defined(EVAL_LEARN) && defined(YANEURAOU_2018_OTAFUKU_ENGINE)
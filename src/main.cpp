@@ -41,7 +41,6 @@ int main(const int argc, char* argv[]) {
   PSQT::init();
   Bitboards::init();
   Position::init();
-  Bitbases::init();
   Endgames::init();
   Threads.set(Options["Threads"]);
   Search::clear(); // After threads are up
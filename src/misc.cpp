@@ -41,16 +41,24 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <vector>
 
 #if defined(__linux__) && !defined(__ANDROID__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 #include "misc.h"
 #include "thread.h"
+#include "uci.h"
 
 using namespace std;
 
@@ -291,25 +299,186 @@ void prefetch(void* addr) {
 #endif
 
 
-/// aligned_ttmem_alloc() will return suitably aligned memory, and if possible use large pages.
-/// The returned pointer is the aligned one, while the mem argument is the one that needs
-/// to be passed to free. With c++17 some of this functionality could be simplified.
+/// aligned_large_pages_alloc() will return suitably aligned memory, and if
+/// possible use large pages. On Linux we first try explicit huge pages from the
+/// hugetlbfs pool with mmap(MAP_HUGETLB), 2MB pages and then 1GB ones, then we
+/// fall back to transparent huge pages through madvise(MADV_HUGEPAGE) and at
+/// last to normal pages. Small allocations always use normal pages. The kind
+/// of pages actually obtained is returned in 'kind' when not nullptr. Every
+/// allocation is recorded, so that aligned_large_pages_free() knows how to
+/// release it.
+
+namespace {
+
+constexpr size_t HugePageSize = 2 * 1024 * 1024;
+constexpr size_t GigaPageSize = 1024 * 1024 * 1024;
+
+struct Allocation {
+  void* base;
+  size_t size;
+  PageKind kind;
+};
+
+std::mutex allocMutex;
+
+std::map<void*, Allocation>& allocations() {
+
+  // Keyed by the aligned pointer. Never destroyed, because static objects
+  // release their memory at exit, possibly after the registry destructor ran.
+  static auto* registry = new std::map<void*, Allocation>();
+  return *registry;
+}
+
+void* normal_pages_alloc(const size_t size, Allocation& a) {
+
+  constexpr size_t alignment = 4096; // Page aligned, enough for any alignas()
+  a.base = malloc(size + alignment - 1);
+  a.size = size;
+  a.kind = NORMAL_PAGES;
+
+  return a.base ? reinterpret_cast<void*>((uintptr_t(a.base) + alignment - 1) & ~uintptr_t(alignment - 1))
+                : nullptr;
+}
+
+} // namespace
 
 #if defined(__linux__) && !defined(__ANDROID__)
 
-void* aligned_ttmem_alloc(size_t allocSize, void*& mem) {
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+static void* hugetlb_alloc(const size_t size, const size_t pageSize, const int log2PageSize, Allocation& a) {
 
-  constexpr size_t alignment = 2 * 1024 * 1024; // assumed 2MB page sizes
-  size_t size = ((allocSize + alignment - 1) / alignment) * alignment; // multiple of alignment
-  if (posix_memalign(&mem, alignment, size))
-     mem = nullptr;
-  madvise(mem, allocSize, MADV_HUGEPAGE);
-  return mem;
+  a.size = (size + pageSize - 1) / pageSize * pageSize;
+  a.base = mmap(nullptr, a.size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | log2PageSize << MAP_HUGE_SHIFT, -1, 0);
+
+  if (a.base == MAP_FAILED)
+      a.base = nullptr;
+
+  return a.base;
+}
+
+/// thp_enabled() checks that transparent huge pages are not disabled system
+/// wide, in which case madvise() still succeeds but has no effect.
+
+static bool thp_enabled() {
+
+  static const bool enabled = [] {
+      ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+      string mode;
+      return getline(file, mode) && mode.find("[never]") == string::npos;
+  }();
+
+  return enabled;
+}
+
+static void* aligned_large_pages_alloc_os(const size_t allocSize, Allocation& a) {
+
+  if (allocSize < HugePageSize)
+      return normal_pages_alloc(allocSize, a);
+
+  // Explicit huge pages, only available if the administrator reserved them
+  a.kind = HUGE_PAGES_2MB;
+  if (hugetlb_alloc(allocSize, HugePageSize, 21, a))
+      return a.base;
+
+  a.kind = HUGE_PAGES_1GB;
+  if (allocSize >= GigaPageSize && hugetlb_alloc(allocSize, GigaPageSize, 30, a))
+      return a.base;
+
+  // Transparent huge pages, the kernel may still give us normal pages
+  a.size = (allocSize + HugePageSize - 1) / HugePageSize * HugePageSize; // multiple of alignment
+  if (posix_memalign(&a.base, HugePageSize, a.size))
+      return normal_pages_alloc(allocSize, a);
+
+  a.kind = !madvise(a.base, a.size, MADV_HUGEPAGE) && thp_enabled() ? TRANSPARENT_HUGE_PAGES : NORMAL_PAGES;
+  return a.base;
+}
+
+static void* map_file_pages_os(const std::string& fname, const size_t offset, const size_t size, Allocation& a) {
+
+  const int fd = open(fname.c_str(), O_RDONLY);
+  if (fd == -1)
+      return nullptr;
+
+  // A private mapping: pages are read lazily from the file and copied on
+  // write, so the file itself is never modified.
+  a.base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, static_cast<off_t>(offset));
+  a.size = size;
+  a.kind = FILE_MAPPED_PAGES;
+  close(fd);
+
+  if (a.base == MAP_FAILED)
+      a.base = nullptr;
+
+  return a.base;
+}
+
+static std::string shm_name(const std::string& name) {
+  return name[0] == '/' ? name : "/" + name;
+}
+
+static void* map_shared_pages_os(const std::string& name, size_t& size, bool& created, Allocation& a) {
+
+  // Exactly one process creates and sizes the segment, the others attach to
+  // it with the size chosen by the creator.
+  int fd = shm_open(shm_name(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  created = fd != -1;
+
+  if (created && ftruncate(fd, static_cast<off_t>(size)))
+  {
+      close(fd);
+      shm_unlink(shm_name(name).c_str());
+      return nullptr;
+  }
+
+  if (!created)
+  {
+      if ((fd = shm_open(shm_name(name).c_str(), O_RDWR, 0600)) == -1)
+          return nullptr;
+
+      // The creator may not have sized the segment yet
+      struct stat st;
+      for (int i = 0; i < 100 && !fstat(fd, &st) && !st.st_size; ++i)
+          sleep(10);
+
+      if (fstat(fd, &st) || !st.st_size)
+      {
+          close(fd);
+          return nullptr;
+      }
+      size = static_cast<size_t>(st.st_size);
+  }
+
+  a.base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  a.size = size;
+  a.kind = SHARED_MEMORY_PAGES;
+  close(fd);
+
+  if (a.base == MAP_FAILED)
+      a.base = nullptr;
+  else
+      madvise(a.base, size, MADV_HUGEPAGE); // Effective only if shmem THP is enabled
+
+  return a.base;
+}
+
+static void unlink_shared_pages_os(const std::string& name) { shm_unlink(shm_name(name).c_str()); }
+
+static void aligned_large_pages_free_os(const Allocation& a) {
+
+  if (   a.kind == HUGE_PAGES_2MB || a.kind == HUGE_PAGES_1GB
+      || a.kind == FILE_MAPPED_PAGES || a.kind == SHARED_MEMORY_PAGES)
+      munmap(a.base, a.size);
+  else
+      free(a.base);
 }
 
 #elif defined(_WIN64)
 
-static void* aligned_ttmem_alloc_large_pages(size_t allocSize) {
+static void* aligned_large_pages_alloc_windows(size_t allocSize) {
 
   HANDLE hProcessToken { };
   LUID luid { };
@@ -354,72 +523,310 @@ static void* aligned_ttmem_alloc_large_pages(size_t allocSize) {
   return mem;
 }
 
-void* aligned_ttmem_alloc(const size_t size, void*& mem) {
+static void* aligned_large_pages_alloc_os(const size_t size, Allocation& a) {
+
+  if (size < HugePageSize)
+      return normal_pages_alloc(size, a);
+
+  a.size = size;
+  a.kind = WINDOWS_LARGE_PAGES;
+
+  // Try to allocate large pages, and fall back to regular, page aligned,
+  // allocation if necessary.
+  if (!(a.base = aligned_large_pages_alloc_windows(size)))
+  {
+      a.kind = NORMAL_PAGES;
+      a.base = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  }
+
+  return a.base;
+}
+
+static void* map_file_pages_os(const std::string&, size_t, size_t, Allocation&) { return nullptr; }
 
-  static bool firstCall = true;
+static void* map_shared_pages_os(const std::string&, size_t&, bool&, Allocation&) { return nullptr; }
 
-  // Try to allocate large pages
-  mem = aligned_ttmem_alloc_large_pages(size);
+static void unlink_shared_pages_os(const std::string&) {}
 
-  // Suppress info strings on the first call. The first call occurs before 'uci'
-  // is received and in that case this output confuses some GUIs.
-  if (!firstCall)
+static void aligned_large_pages_free_os(const Allocation& a) {
+
+  if (a.size < HugePageSize)
+      free(a.base);
+
+  else if (!VirtualFree(a.base, 0, MEM_RELEASE))
   {
-      if (mem)
-          sync_cout << "info string Hash table allocation: Windows large pages used." << sync_endl;
-      //else
-          //sync_cout << "info string Hash table allocation: Windows large pages not used." << sync_endl;
+      const DWORD err = GetLastError();
+      std::cerr << "Failed to free large page memory. Error code: 0x" <<
+          std::hex << err << std::dec << std::endl;
+      exit(EXIT_FAILURE);
   }
-  firstCall = false;
+}
+
+#else
+
+static void* aligned_large_pages_alloc_os(const size_t size, Allocation& a) {
+  return normal_pages_alloc(size, a);
+}
+
+static void* map_file_pages_os(const std::string&, size_t, size_t, Allocation&) { return nullptr; }
+
+static void* map_shared_pages_os(const std::string&, size_t&, bool&, Allocation&) { return nullptr; }
+
+static void unlink_shared_pages_os(const std::string&) {}
+
+static void aligned_large_pages_free_os(const Allocation& a) { free(a.base); }
+
+#endif
+
+void* aligned_large_pages_alloc(const size_t size, PageKind* kind) {
+
+  Allocation a { };
+  void* mem = aligned_large_pages_alloc_os(size, a);
 
-  // Fall back to regular, page aligned, allocation if necessary
   if (!mem)
-      mem = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+      return nullptr;
 
+  if (kind)
+      *kind = a.kind;
+
+  std::lock_guard lk(allocMutex);
+  allocations()[mem] = a;
   return mem;
 }
 
-#else
 
-void* aligned_ttmem_alloc(size_t allocSize, void*& mem) {
+/// map_file_pages() maps size bytes of the given file, starting at offset that
+/// must be a multiple of the page size, as private writable memory. It returns
+/// nullptr when mapping is not possible, e.g. on platforms other than Linux.
+/// The memory is released with aligned_large_pages_free().
+
+void* map_file_pages(const std::string& fname, const size_t offset, const size_t size) {
+
+  Allocation a { };
+  void* mem = map_file_pages_os(fname, offset, size, a);
+
+  if (!mem)
+      return nullptr;
+
+  std::lock_guard lk(allocMutex);
+  allocations()[mem] = a;
+  return mem;
+}
+
+
+/// map_shared_pages() maps the named POSIX shared memory segment, creating it
+/// with the given size if it does not exist yet, in which case 'created' is
+/// set. When attaching to an existing segment, size is set to its actual size.
+/// It returns nullptr when shared memory is not available, e.g. on platforms
+/// other than Linux. The memory is released with aligned_large_pages_free(),
+/// while the segment itself persists until unlink_shared_pages() is called.
+
+void* map_shared_pages(const std::string& name, size_t& size, bool& created) {
 
-  constexpr size_t alignment = 64; // assumed cache line size
-  size_t size = allocSize + alignment - 1; // allocate some extra space
-  mem = malloc(size);
-  void* ret = reinterpret_cast<void*>((uintptr_t(mem) + alignment - 1) & ~uintptr_t(alignment - 1));
-  return ret;
+  Allocation a { };
+  void* mem = name.empty() ? nullptr : map_shared_pages_os(name, size, created, a);
+
+  if (!mem)
+      return nullptr;
+
+  std::lock_guard lk(allocMutex);
+  allocations()[mem] = a;
+  return mem;
 }
 
+void unlink_shared_pages(const std::string& name) { unlink_shared_pages_os(name); }
+
+
+/// process_id() and process_alive() let the processes sharing a memory segment
+/// find the ones that died without detaching from it. They are only meaningful
+/// where map_shared_pages() is supported, and for processes that share a pid
+/// namespace. Elsewhere every process is considered alive.
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+int process_id() { return static_cast<int>(getpid()); }
+
+bool process_alive(const int pid) { return !kill(pid, 0) || errno == EPERM; }
+
+#else
+
+int process_id() { return 0; }
+
+bool process_alive(int) { return true; }
+
 #endif
 
 
-/// aligned_ttmem_free() will free the previously allocated ttmem
+/// aligned_large_pages_free() will free the memory previously allocated by
+/// aligned_large_pages_alloc(), map_file_pages() or map_shared_pages().
 
-#if defined(_WIN64)
+void aligned_large_pages_free(void* mem) {
 
-void aligned_ttmem_free(void* mem) {
+  if (!mem)
+      return;
 
-  if (mem && !VirtualFree(mem, 0, MEM_RELEASE))
+  Allocation a;
   {
-	  const DWORD err = GetLastError();
-      std::cerr << "Failed to free transposition table. Error code: 0x" <<
-          std::hex << err << std::dec << std::endl;
-      exit(EXIT_FAILURE);
+      std::lock_guard lk(allocMutex);
+      const auto it = allocations().find(mem);
+
+      // Not ours, or already freed: leaking is safer than guessing how to free it.
+      // This may run from static destructors, after the I/O mutex of sync_cout
+      // is destroyed, so report on std::cerr.
+      if (it == allocations().end())
+      {
+          std::cerr << "aligned_large_pages_free: unknown pointer " << mem << std::endl;
+          assert(false);
+          return;
+      }
+
+      a = it->second;
+      allocations().erase(it);
   }
+
+  aligned_large_pages_free_os(a);
 }
 
-#else
 
-void aligned_ttmem_free(void *mem) {
-  free(mem);
-}
+/// page_kind_string() returns a description of the kind of pages, as used in
+/// the info strings reporting allocations.
 
-#endif
+std::string page_kind_string(const PageKind kind) {
+
+  return kind == HUGE_PAGES_1GB         ? "1GB huge pages"
+       : kind == HUGE_PAGES_2MB         ? "2MB huge pages"
+       : kind == TRANSPARENT_HUGE_PAGES ? "transparent huge pages"
+       : kind == WINDOWS_LARGE_PAGES    ? "Windows large pages"
+       : kind == FILE_MAPPED_PAGES      ? "file mapped pages"
+       : kind == SHARED_MEMORY_PAGES    ? "shared memory pages" : "normal pages";
+}
 
 
 namespace WinProcGroup {
 
-#ifndef _WIN32
+/// use_binding() tells if threads of a pool of the given size should be bound
+/// at all, according to the "Thread Binding" policy. In Auto mode, if the OS
+/// already scheduled us on a different group than 0 then don't overwrite the
+/// choice, eventually we are one of many one-threaded processes running on
+/// some NUMA hardware, for instance in fishtest. To make it simple, just check
+/// if running threads are below a threshold, in this case all this NUMA
+/// machinery is not needed.
+
+static bool use_binding() {
+
+  return    !(Options["Thread Binding"] == "None")
+         && (!(Options["Thread Binding"] == "Auto") || Options["Threads"] > 8);
+}
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+/// read_list() reads a list of ranges, e.g. "0-15,32-47", as found in the
+/// files of /sys/devices/system/node. Returns an empty list if the file
+/// cannot be read.
+
+static std::vector<int> read_list(const string& fname) {
+
+  std::vector<int> values;
+  ifstream file(fname);
+  string range;
+
+  while (getline(file, range, ','))
+  {
+      int first, last;
+      char dash;
+      istringstream ss(range);
+      if (!(ss >> first))
+          continue;
+      last = ss >> dash >> last ? last : first;
+
+      for (int v = first; v <= last; ++v)
+          values.push_back(v);
+  }
+
+  return values;
+}
+
+
+/// nodes() parses the NUMA topology exported by the kernel under
+/// /sys/devices/system/node. The "online" file lists the nodes, and each
+/// nodeN/cpulist file the logical processors of node N. The topology is read
+/// only once, and nodes without processors are skipped.
+
+static const std::vector<std::vector<int>>& nodes() {
+
+  static const std::vector<std::vector<int>> topology = [] {
+
+      std::vector<std::vector<int>> result;
+
+      for (const int n : read_list("/sys/devices/system/node/online"))
+          if (auto cpus = read_list("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist"); !cpus.empty())
+              result.push_back(std::move(cpus));
+
+      return result;
+  }();
+
+  return topology;
+}
+
+
+/// best_group() returns the NUMA node for the thread with index idx. With the
+/// Compact policy we fill a node up to its processor count before moving on
+/// to the next one, with Spread we go round robin over the nodes. If we have
+/// more threads than logical processors then return -1 and let the OS decide.
+
+static int best_group(const size_t idx) {
+
+  const auto& topology = nodes();
+
+  if (topology.size() < 2 || !use_binding())
+      return -1;
+
+  size_t cpuCount = 0;
+  for (const auto& cpus : topology)
+      cpuCount += cpus.size();
+
+  if (idx >= cpuCount)
+      return -1;
+
+  if (Options["Thread Binding"] == "Spread")
+      return static_cast<int>(idx % topology.size());
+
+  size_t first = 0;
+  for (size_t n = 0; n < topology.size(); ++n)
+  {
+      if (idx < first + topology[n].size())
+          return static_cast<int>(n);
+      first += topology[n].size();
+  }
+
+  return -1;
+}
+
+
+/// bindThisThread() sets the affinity of the current thread to all the
+/// logical processors of its NUMA node. Memory touched first by the thread
+/// afterwards is then allocated on that node by the kernel.
+
+void bindThisThread(const size_t idx) {
+
+  const int node = best_group(idx);
+
+  if (node == -1)
+      return;
+
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+
+  for (const int cpu : nodes()[node])
+      if (cpu < CPU_SETSIZE)
+          CPU_SET(cpu, &mask);
+
+  sched_setaffinity(0, sizeof(cpu_set_t), &mask);
+}
+
+#elif !defined(_WIN32)
+
+static int best_group(size_t) { return -1; }
 
 void bindThisThread(size_t) {}
 
@@ -431,6 +838,9 @@ void bindThisThread(size_t) {}
 
 int best_group(const size_t idx) {
 
+  if (!use_binding())
+      return -1;
+
   int threads = 0;
   int nodes = 0;
   int cores = 0;
@@ -476,6 +886,10 @@ int best_group(const size_t idx) {
 
   free(buffer);
 
+  // With the Spread policy go round robin over the nodes
+  if (Options["Thread Binding"] == "Spread")
+      return idx < static_cast<size_t>(threads) ? static_cast<int>(idx % nodes) : -1;
+
   std::vector<int> groups;
 
   // Run as many threads as possible on the same node until core limit is
@@ -521,6 +935,33 @@ void bindThisThread(const size_t idx) {
 
 #endif
 
+
+/// layout() describes how a pool of the given size is spread over the NUMA
+/// nodes, e.g. "Thread binding Compact: node 0 8 threads, node 1 4 threads".
+/// An empty string is returned when threads are not bound.
+
+std::string layout(const size_t threadCount) {
+
+  std::map<int, size_t> perNode;
+  for (size_t idx = 0; idx < threadCount; ++idx)
+      if (const int node = best_group(idx); node != -1)
+          perNode[node]++;
+
+  if (perNode.empty())
+      return "";
+
+  std::stringstream ss;
+  ss << "Thread binding "
+     << (  Options["Thread Binding"] == "Spread"  ? "Spread"
+         : Options["Thread Binding"] == "Compact" ? "Compact" : "Auto") << ":";
+
+  for (const auto& [node, cnt] : perNode)
+      ss << (node == perNode.begin()->first ? " " : ", ")
+         << "node " << node << " " << cnt << (cnt > 1 ? " threads" : " thread");
+
+  return ss.str();
+}
+
 } // namespace WinProcGroup
 
 // Returns a string that represents the current time. (Used when learning evaluation functions)
@@ -39,8 +39,21 @@ std::string engine_info(bool to_uci = false);
 std::string compiler_info();
 void prefetch(void* addr);
 void start_logger(const std::string& fname);
-void* aligned_ttmem_alloc(size_t size, void*& mem);
-void aligned_ttmem_free(void* mem); // nop if mem == nullptr
+
+/// Kinds of memory pages that aligned_large_pages_alloc() can obtain
+enum PageKind {
+  NORMAL_PAGES, TRANSPARENT_HUGE_PAGES, HUGE_PAGES_2MB, HUGE_PAGES_1GB, WINDOWS_LARGE_PAGES,
+  FILE_MAPPED_PAGES, SHARED_MEMORY_PAGES
+};
+
+void* aligned_large_pages_alloc(size_t size, PageKind* kind = nullptr);
+void* map_file_pages(const std::string& fname, size_t offset, size_t size);
+void* map_shared_pages(const std::string& name, size_t& size, bool& created);
+void unlink_shared_pages(const std::string& name);
+int process_id();
+bool process_alive(int pid);
+void aligned_large_pages_free(void* mem); // nop if mem == nullptr
+std::string page_kind_string(PageKind kind);
 
 void dbg_hit_on(bool b);
 void dbg_hit_on(bool c, bool b);
@@ -60,6 +73,10 @@ template<class Entry, int Size>
 struct HashTable {
   Entry* operator[](const Key key) { return &table[static_cast<uint32_t>(key) & Size - 1]; }
 
+  // Reallocate and zero the table from the calling thread, so that on systems
+  // with a first-touch policy its memory ends up on the thread's NUMA node.
+  void first_touch() { std::vector<Entry>(Size).swap(table); }
+
 private:
   std::vector<Entry> table = std::vector<Entry>(Size); // Allocate on the heap
 };
@@ -128,6 +145,20 @@ inline std::ostream& operator<<(std::ostream& os, const PRNG& prng)
   return os;
 }
 
+/// prng_stream_seed() returns the seed of the stream idx of the master seed, the
+/// SplitMix64 output for the counter idx. Seeding one PRNG per thread this way
+/// gives independent streams without any lock, and the numbers drawn by a
+/// thread do not depend on the scheduling of the others.
+
+inline uint64_t prng_stream_seed(const uint64_t seed, const uint64_t idx) {
+
+  uint64_t z = seed + (idx + 1) * 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z ^= z >> 31;
+  return z ? z : 0x9E3779B97F4A7C15ULL; // PRNG needs a non-zero state
+}
+
 inline uint64_t mul_hi64(const uint64_t a, const uint64_t b) {
 #if defined(__GNUC__) && defined(IS_64BIT)
     __extension__ typedef unsigned __int128 uint128;
@@ -146,10 +177,13 @@ inline uint64_t mul_hi64(const uint64_t a, const uint64_t b) {
 /// logical processor group. This usually means to be limited to use max 64
 /// cores. To overcome this, some special platform specific API should be
 /// called to set group affinity for each thread. Original code from Texel by
-/// Peter Österlund.
+/// Peter Österlund. On Linux the same entry points bind threads to the NUMA
+/// nodes found under /sys/devices/system/node, so that memory first touched
+/// by a thread is local to it. The "Thread Binding" option selects the policy.
 
 namespace WinProcGroup {
   void bindThisThread(size_t idx);
+  std::string layout(size_t threadCount);
 }
 // sleep for the specified number of milliseconds.
 extern void sleep(int ms);
@@ -177,41 +211,6 @@ static void my_exit()
 int read_file_to_memory(const std::string& filename, const std::function<void* (uint64_t)>& callback_func);
 int write_memory_to_file(const std::string& filename, void* ptr, uint64_t size);
 
-// --------------------
-// async version of PRNG
-// --------------------
-
-// async version of PRNG
-struct AsyncPRNG
-{
-	explicit AsyncPRNG(const uint64_t seed) : prng(seed) { assert(seed); }
-  // [ASYNC] Extract one random number.
-  template<typename T> T rand() {
-    std::unique_lock lk(mutex);
-    return prng.rand<T>();
-  }
-
-  // [ASYNC] Returns a random number from 0 to n-1. (Not uniform distribution, but this is enough in reality)
-  uint64_t rand(const uint64_t n) {
-    std::unique_lock lk(mutex);
-    return prng.rand(n);
-  }
-
-  // Return the random seed used internally.
-  [[nodiscard]] uint64_t get_seed() const { return prng.get_seed(); }
-
-protected:
-  std::mutex mutex;
-  PRNG prng;
-};
-
-// Display a random seed. (For debugging)
-inline std::ostream& operator<<(std::ostream& os, const AsyncPRNG& prng)
-{
-  os << "AsyncPRNG::seed = " << std::hex << prng.get_seed() << std::dec;
-  return os;
-}
-
 // --------------------
 //       Math
 // --------------------
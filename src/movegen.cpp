@@ -22,6 +22,7 @@
 
 #include "movegen.h"
 #include "position.h"
+#include "searchstats.h"
 
 namespace {
 
@@ -271,6 +272,7 @@ ExtMove* generate(const Position& pos, ExtMove* moveList) {
 
   static_assert(Type == CAPTURES || Type == QUIETS || Type == NON_EVASIONS, "Unsupported type in generate()");
   assert(!pos.checkers());
+  STATS_TIMER(SearchStats::MOVEGEN_TIME);
 
   const Color us = pos.side_to_move();
 
@@ -290,6 +292,7 @@ template<>
 ExtMove* generate<QUIET_CHECKS>(const Position& pos, ExtMove* moveList) {
 
   assert(!pos.checkers());
+  STATS_TIMER(SearchStats::MOVEGEN_TIME);
 
   const Color us = pos.side_to_move();
   Bitboard dc = pos.blockers_for_king(~us) & pos.pieces(us) & ~pos.pieces(PAWN);
@@ -319,6 +322,7 @@ template<>
 ExtMove* generate<EVASIONS>(const Position& pos, ExtMove* moveList) {
 
   assert(pos.checkers());
+  STATS_TIMER(SearchStats::MOVEGEN_TIME);
 
   const Color us = pos.side_to_move();
   const Square ksq = pos.square<KING>(us);
@@ -21,6 +21,7 @@
 #include <cassert>
 
 #include "movepick.h"
+#include "searchstats.h"
 
 namespace {
 
@@ -148,6 +149,8 @@ Move MovePicker::select(Pred filter) {
 /// moves left, picking the move with the highest score from a list of generated moves.
 Move MovePicker::next_move(const bool skipQuiets) {
 
+  STATS_TIMER(SearchStats::MOVEPICK_TIME);
+
 top:
   switch (stage) {
 
@@ -933,6 +933,11 @@ void Position::do_move(const Move m, StateInfo& newSt, const bool givesCheck) {
   // Update king attacks used for fast check detection
   set_check_info(st);
 
+#if defined(EVAL_NNUE) && defined(NNUE_PREFETCH_WEIGHTS)
+  // The changed features are known now, start loading their weights
+  Eval::prefetch_nnue_weights(*this);
+#endif  // defined(EVAL_NNUE) && defined(NNUE_PREFETCH_WEIGHTS)
+
   // Calculate the repetition info. It is the ply distance from the previous
   // occurrence of the same position, negative in the 3-fold case, or zero
   // if the position was not repeated.
@@ -1126,7 +1131,7 @@ void Position::do_null_move(StateInfo& newSt) {
   }
 
   st->key ^= Zobrist::side;
-  prefetch(TT.first_entry(st->key));
+  prefetch(thisThread->tt->first_entry(st->key));
 
 #if defined(EVAL_NNUE)
   st->accumulator.computed_score = false;
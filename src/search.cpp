@@ -31,6 +31,7 @@
 #include "movepick.h"
 #include "position.h"
 #include "search.h"
+#include "searchstats.h"
 #include "thread.h"
 #include "timeman.h"
 #include "tt.h"
@@ -159,30 +160,221 @@ namespace {
   void update_all_stats(const Position& pos, Stack* ss, Move bestMove, Value bestValue, Value beta, Square prevSq,
                         const Move* quietsSearched, int quietCount, const Move* capturesSearched, int captureCount, Depth depth);
 
+  // PerftTable caches subtree counts keyed by position and depth. Entries are
+  // written by all the perft threads without locks: the key is stored xor-ed
+  // with the count, so an entry torn by a concurrent write is just a miss. The
+  // table is kept between 'go perft' commands, as its entries do not depend on
+  // the root position, and it is released by Search::clear().
+  class PerftTable {
+
+    struct Entry {
+      Key check;
+      uint64_t count;
+    };
+
+    static Key entry_key(const Position& pos, const Depth depth) {
+      return pos.key() ^ (uint64_t(depth) * 0x9E3779B97F4A7C15ULL);
+    }
+
+  public:
+   ~PerftTable() { release(); }
+
+    // resize() allocates the table if its size has changed. A new table is
+    // zeroed by the first 'threadCount' threads of the pool, each one its part.
+    void resize(const size_t mbSize, const size_t threadCount) {
+
+      const size_t newEntryCount = mbSize * 1024 * 1024 / sizeof(Entry);
+
+      if (table && newEntryCount == entryCount)
+          return;
+
+      release();
+      table = static_cast<Entry*>(aligned_large_pages_alloc(newEntryCount * sizeof(Entry)));
+
+      if (!table)
+          return;
+
+      entryCount = newEntryCount;
+
+      auto zero = [this, threadCount](const size_t idx) {
+          const size_t stride = entryCount / threadCount,
+                       start  = stride * idx,
+                       len    = idx != threadCount - 1 ? stride : entryCount - start;
+
+          std::memset(&table[start], 0, len * sizeof(Entry));
+      };
+
+      for (size_t idx = 1; idx < threadCount; ++idx)
+          Threads[idx]->run_custom_job([&zero, idx] { zero(idx); });
+
+      zero(0);
+
+      for (size_t idx = 1; idx < threadCount; ++idx)
+          Threads[idx]->wait_for_search_finished();
+    }
+
+    void release() {
+
+      aligned_large_pages_free(table);
+      table = nullptr;
+      entryCount = 0;
+    }
+
+    bool probe(const Position& pos, const Depth depth, uint64_t& count) const {
+
+      if (!entryCount)
+          return false;
+
+      const Key k = entry_key(pos, depth);
+      const Entry* e = &table[mul_hi64(k, entryCount)];
+      const uint64_t c = e->count;
+
+      if ((e->check ^ c) != k)
+          return false;
+
+      count = c;
+      return true;
+    }
+
+    void save(const Position& pos, const Depth depth, const uint64_t count) const {
+
+      if (!entryCount)
+          return;
+
+      const Key k = entry_key(pos, depth);
+      Entry* e = &table[mul_hi64(k, entryCount)];
+      e->check = k ^ count;
+      e->count = count;
+    }
+
+  private:
+    Entry* table = nullptr;
+    size_t entryCount = 0;
+  };
+
+  PerftTable PerftTT;
+
   // perft() is our utility to verify move generation. All the leaf nodes up
   // to the given depth are generated and counted, and the sum is returned.
-  template<bool Root>
-  uint64_t perft(Position& pos, const Depth depth) {
+  // The last ply is bulk counted from the size of the legal move list.
+  uint64_t perft(Position& pos, const Depth depth, const PerftTable& table) {
+
+    if (depth == 1)
+        return MoveList<LEGAL>(pos).size();
+
+    uint64_t nodes = 0;
+
+    if (table.probe(pos, depth, nodes))
+        return nodes;
 
     StateInfo st;
-    uint64_t cnt, nodes = 0;
-    const bool leaf = depth == 2;
 
     for (const auto& m : MoveList<LEGAL>(pos))
     {
-        if (Root && depth <= 1)
-            cnt = 1, nodes++;
-        else
+        pos.do_move(m, st);
+        nodes += perft(pos, depth - 1, table);
+        pos.undo_move(m);
+    }
+
+    table.save(pos, depth, nodes);
+    return nodes;
+  }
+
+  // perft_root() splits the work among the first 'threadCount' threads of the
+  // pool, each one counting from its own copy of the root position and sharing
+  // PerftTT, sized by the "Hash" option. A job is a root move, or a root move
+  // and a reply when there are fewer root moves than threads, so that all the
+  // threads are busy. Counts are printed by root move in move generation
+  // order, followed by the total and the nodes per second.
+  void perft_root(const Depth depth, const size_t threadCount) {
+
+    struct Job {
+      size_t rootIdx;
+      Move moves[2];
+      int length;
+      uint64_t count;
+    };
+
+    const TimePoint startTime = now();
+    Position& rootPos = Threads.main()->rootPos;
+    const MoveList<LEGAL> moves(rootPos);
+    std::vector<Job> jobs;
+    std::atomic<size_t> nextJob(0);
+
+    PerftTT.resize(static_cast<size_t>(Options["Hash"]), threadCount);
+
+    for (size_t i = 0; i < moves.size(); ++i)
+    {
+        const Move m = moves.begin()[i];
+
+        if (depth < 3 || moves.size() >= threadCount)
         {
-            pos.do_move(m, st);
-            cnt = leaf ? MoveList<LEGAL>(pos).size() : perft<false>(pos, depth - 1);
-            nodes += cnt;
-            pos.undo_move(m);
+            jobs.push_back({ i, { m, MOVE_NONE }, 1, 0 });
+            continue;
         }
-        if (Root)
-            sync_cout << UCI::move(m, pos.is_chess960()) << ": " << cnt << sync_endl;
+
+        StateInfo st;
+        rootPos.do_move(m, st);
+
+        for (const auto& reply : MoveList<LEGAL>(rootPos))
+            jobs.push_back({ i, { m, reply }, 2, 0 });
+
+        rootPos.undo_move(m);
     }
-    return nodes;
+
+    auto worker = [&](Thread* th) {
+        Position& pos = th->rootPos;
+        StateInfo st[2];
+
+        for (size_t j; (j = nextJob++) < jobs.size(); )
+        {
+            Job& job = jobs[j];
+
+            if (depth <= 1)
+            {
+                job.count = 1;
+                continue;
+            }
+
+            for (int k = 0; k < job.length; ++k)
+                pos.do_move(job.moves[k], st[k]);
+
+            job.count = perft(pos, depth - job.length, PerftTT);
+
+            for (int k = job.length - 1; k >= 0; --k)
+                pos.undo_move(job.moves[k]);
+        }
+    };
+
+    for (size_t idx = 1; idx < threadCount; ++idx)
+    {
+        Thread* th = Threads[idx];
+        th->run_custom_job([&worker, th] { worker(th); });
+    }
+
+    worker(Threads.main());
+
+    for (size_t idx = 1; idx < threadCount; ++idx)
+        Threads[idx]->wait_for_search_finished();
+
+    std::vector<uint64_t> counts(moves.size());
+    uint64_t nodes = 0;
+
+    for (const Job& job : jobs)
+        counts[job.rootIdx] += job.count;
+
+    for (size_t i = 0; i < moves.size(); ++i)
+    {
+        nodes += counts[i];
+        sync_cout << UCI::move(moves.begin()[i], rootPos.is_chess960())
+                  << ": " << counts[i] << sync_endl;
+    }
+
+    const TimePoint elapsed = now() - startTime + 1; // Ensure positivity to avoid a 'divide by zero'
+
+    sync_cout << "info nodes " << nodes << " nps " << nodes * 1000 / elapsed
+              << " time " << elapsed << " threads " << threadCount << sync_endl;
+    sync_cout << "\nNodes searched: " << nodes << "\n" << sync_endl;
   }
 
 } // namespace
@@ -205,6 +397,7 @@ void Search::clear() {
 
   Time.availableNodes = 0;
   TT.clear();
+  PerftTT.release();
   Threads.clear();
   Tablebases::init(Options["SyzygyPath"]); // Free mapped files
 }
@@ -217,8 +410,8 @@ void MainThread::search() {
 
   if (Limits.perft)
   {
-      nodes = perft<true>(rootPos, Limits.perft);
-      sync_cout << "\nNodes searched: " << nodes << "\n" << sync_endl;
+      perft_root(Limits.perft, Limits.perftThreads ? std::min(static_cast<size_t>(Limits.perftThreads), Threads.size())
+                                                   : Threads.size());
       return;
   }
 
@@ -274,6 +467,16 @@ void MainThread::search() {
   if (bestThread != this)
       sync_cout << UCI::pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
 
+  // Report the tablebase probe cache efficiency and the cost of a miss
+  if (const TB::ProbeStats tbStats = TB::stats(); tbStats.probes && !Limits.silent)
+  {
+      const uint64_t misses = tbStats.probes - tbStats.cacheHits;
+      sync_cout << "info string tbprobes " << tbStats.probes
+                << " cachehits " << tbStats.cacheHits
+                << " hitrate " << tbStats.cacheHits * 100 / tbStats.probes << "%"
+                << " misslatency " << (misses ? tbStats.missTime / misses / 1000 : 0) << "us" << sync_endl;
+  }
+
   sync_cout << "bestmove " << UCI::move(bestThread->rootMoves[0].pv[0], rootPos.is_chess960());
 
   if (bestThread->rootMoves[0].pv.size() > 1 || bestThread->rootMoves[0].extract_ponder_from_tt(rootPos))
@@ -348,15 +551,8 @@ void Thread::search() {
   multiPV = std::min(multiPV, rootMoves.size());
   ttHitAverage = TtHitAverageWindow * TtHitAverageResolution / 2;
 
-  int ct = static_cast<int>(Options["Contempt"]) * PawnValueEg / 100; // From centipawns
-
   // In analysis mode, adjust contempt in accordance with user preference
-  if (Limits.infinite || static_cast<bool>(Options["UCI_AnalyseMode"]))
-      ct =  Options["Analysis Contempt"] == "Off"  ? 0
-          : Options["Analysis Contempt"] == "Both" ? ct
-          : Options["Analysis Contempt"] == "White" && us == BLACK ? -ct
-          : Options["Analysis Contempt"] == "Black" && us == WHITE ? -ct
-          : ct;
+  const int ct = Conf.contempt_for(us, Limits.infinite || Conf.analyseMode);
 
   // Evaluation score is from the white point of view
   contempt = us == WHITE ?  make_score(ct, ct / 2)
@@ -366,8 +562,8 @@ void Thread::search() {
 
   // Iterative deepening loop until requested to stop or the target depth is reached
   while (   ++rootDepth < MAX_PLY
-         && !Threads.stop
-         && !(Limits.depth && mainThread && rootDepth > Limits.depth))
+         && !*stopFlag
+         && !(Limits.depth && (mainThread || stopFlag == &groupStop) && rootDepth > Limits.depth))
   {
       // Age out PV variability metric
       if (mainThread)
@@ -385,7 +581,7 @@ void Thread::search() {
          searchAgainCounter++;
 
       // MultiPV loop. We perform a full root search for each PV line
-      for (pvIdx = 0; pvIdx < multiPV && !Threads.stop; ++pvIdx)
+      for (pvIdx = 0; pvIdx < multiPV && !*stopFlag; ++pvIdx)
       {
           if (pvIdx == pvLast)
           {
@@ -433,12 +629,13 @@ void Thread::search() {
               // If search has been stopped, we break immediately. Sorting is
               // safe because RootMoves is still valid, although it refers to
               // the previous iteration.
-              if (Threads.stop)
+              if (*stopFlag)
                   break;
 
               // When failing high/low give some update (without cluttering
               // the UI) before a re-search.
               if (   mainThread
+                  && !Limits.silent
                   && multiPV == 1
                   && (bestValue <= alpha || bestValue >= beta)
                   && Time.elapsed() > 3000)
@@ -475,11 +672,12 @@ void Thread::search() {
           std::stable_sort(rootMoves.begin() + pvFirst, rootMoves.begin() + pvIdx + 1);
 
           if (    mainThread
-              && (Threads.stop || pvIdx + 1 == multiPV || Time.elapsed() > 3000))
+              && !Limits.silent
+              && (*stopFlag || pvIdx + 1 == multiPV || Time.elapsed() > 3000))
               sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
       }
 
-      if (!Threads.stop)
+      if (!*stopFlag)
           completedDepth = rootDepth;
 
       if (rootMoves[0].pv[0] != lastBestMove) {
@@ -491,7 +689,7 @@ void Thread::search() {
       if (   Limits.mate
           && bestValue >= VALUE_MATE_IN_MAX_PLY
           && VALUE_MATE - bestValue <= 2 * Limits.mate)
-          Threads.stop = true;
+          *stopFlag = true;
 
       if (!mainThread)
           continue;
@@ -608,11 +806,15 @@ namespace {
     moveCount = captureCount = quietCount = ss->moveCount = 0;
     bestValue = -VALUE_INFINITE;
     maxValue = VALUE_INFINITE;
+    STATS_INC(PvNode ? SearchStats::PV_NODES : SearchStats::NON_PV_NODES);
 
     // Check for the available remaining time
     if (thisThread == Threads.main())
 	    dynamic_cast<MainThread*>(thisThread)->check_time();
 
+    if (thisThread->nodesLimit || thisThread->timeLimit)
+        thisThread->check_limits();
+
     // Used to send selDepth info to GUI (selDepth counts from 1, ply from 0)
     if (PvNode && thisThread->selDepth < ss->ply + 1)
         thisThread->selDepth = ss->ply + 1;
@@ -620,7 +822,7 @@ namespace {
     if (!rootNode)
     {
         // Step 2. Check for aborted search and immediate draw
-        if (   Threads.stop.load(std::memory_order_relaxed)
+        if (   thisThread->stopFlag->load(std::memory_order_relaxed)
             || pos.is_draw(ss->ply)
             || ss->ply >= MAX_PLY)
             return ss->ply >= MAX_PLY && !ss->inCheck ? evaluate(pos)
@@ -660,7 +862,8 @@ namespace {
     // position key in case of an excluded move.
     excludedMove = ss->excludedMove;
     posKey = excludedMove == MOVE_NONE ? pos.key() : pos.key() ^ make_key(excludedMove);
-    tte = TT.probe(posKey, ttHit);
+    tte = thisThread->tt->probe(posKey, ttHit);
+    STATS_TT_PROBE(depth, ttHit);
     ttValue = ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
     ttMove =  rootNode ? thisThread->rootMoves[thisThread->pvIdx].pv[0]
             : ttHit    ? tte->move() : MOVE_NONE;
@@ -745,7 +948,7 @@ namespace {
                 {
                     tte->save(posKey, value_to_tt(value, ss->ply), ttPv, b,
                               std::min(MAX_PLY - 1, depth + 6),
-                              MOVE_NONE, VALUE_NONE);
+                              MOVE_NONE, VALUE_NONE, thisThread->tt->generation());
 
                     return value;
                 }
@@ -797,7 +1000,7 @@ namespace {
 	    else
 		    ss->staticEval = eval = -(ss-1)->staticEval + 2 * Tempo;
 
-	    tte->save(posKey, VALUE_NONE, ttPv, BOUND_NONE, DEPTH_NONE, MOVE_NONE, eval);
+	    tte->save(posKey, VALUE_NONE, ttPv, BOUND_NONE, DEPTH_NONE, MOVE_NONE, eval, thisThread->tt->generation());
     }
 
     // Step 7. Razoring (~1 Elo)
@@ -922,7 +1125,7 @@ namespace {
                 {
                     tte->save(posKey, value_to_tt(value, ss->ply), ttPv,
                         BOUND_LOWER,
-                        depth - 3, move, ss->staticEval);
+                        depth - 3, move, ss->staticEval, thisThread->tt->generation());
                     return value;
                 }
             }
@@ -933,7 +1136,7 @@ namespace {
     {
         search<NT>(pos, ss, alpha, beta, depth - 7, cutNode);
 
-        tte = TT.probe(posKey, ttHit);
+        tte = thisThread->tt->probe(posKey, ttHit);
         ttValue = ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
         ttMove = ttHit ? tte->move() : MOVE_NONE;
     }
@@ -1133,7 +1336,7 @@ moves_loop: // When in check, search starts from here
       newDepth += extension;
 
       // Speculative prefetch as early as possible
-      prefetch(TT.first_entry(pos.key_after(move)));
+      prefetch(thisThread->tt->first_entry(pos.key_after(move)));
 
       // Check for legality just before making the move
       if (!rootNode && !pos.legal(move))
@@ -1285,7 +1488,7 @@ moves_loop: // When in check, search starts from here
       // Finished searching the move. If a stop occurred, the return value of
       // the search cannot be trusted, and we return immediately without
       // updating best move, PV and TT.
-      if (Threads.stop.load(std::memory_order_relaxed))
+      if (thisThread->stopFlag->load(std::memory_order_relaxed))
           return VALUE_ZERO;
 
       if (rootNode)
@@ -1335,6 +1538,7 @@ moves_loop: // When in check, search starts from here
               {
                   assert(value >= beta); // Fail high
                   ss->statScore = 0;
+                  STATS_CUTOFF(moveCount);
                   break;
               }
           }
@@ -1385,7 +1589,7 @@ moves_loop: // When in check, search starts from here
         tte->save(posKey, value_to_tt(bestValue, ss->ply), ttPv,
                   bestValue >= beta ? BOUND_LOWER :
                   PvNode && bestMove ? BOUND_EXACT : BOUND_UPPER,
-                  depth, bestMove, ss->staticEval);
+                  depth, bestMove, ss->staticEval, thisThread->tt->generation());
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1422,6 +1626,7 @@ moves_loop: // When in check, search starts from here
     Move bestMove = MOVE_NONE;
     ss->inCheck = pos.checkers();
     int moveCount = 0;
+    STATS_INC(SearchStats::QSEARCH_NODES);
 
     // Check for an immediate draw or maximum ply reached
     if (   pos.is_draw(ss->ply)
@@ -1438,7 +1643,7 @@ moves_loop: // When in check, search starts from here
 	                          : DEPTH_QS_NO_CHECKS;
     // Transposition table lookup
     const Key posKey = pos.key();
-    TTEntry* tte = TT.probe(posKey, ttHit);
+    TTEntry* tte = thisThread->tt->probe(posKey, ttHit);
     const Value ttValue = ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
     const Move ttMove = ttHit ? tte->move() : MOVE_NONE;
     const bool pvHit = ttHit && tte->is_pv();
@@ -1480,7 +1685,7 @@ moves_loop: // When in check, search starts from here
         {
             if (!ttHit)
                 tte->save(posKey, value_to_tt(bestValue, ss->ply), false, BOUND_LOWER,
-                          DEPTH_NONE, MOVE_NONE, ss->staticEval);
+                          DEPTH_NONE, MOVE_NONE, ss->staticEval, thisThread->tt->generation());
 
             return bestValue;
         }
@@ -1540,7 +1745,7 @@ moves_loop: // When in check, search starts from here
           continue;
 
       // Speculative prefetch as early as possible
-      prefetch(TT.first_entry(pos.key_after(move)));
+      prefetch(thisThread->tt->first_entry(pos.key_after(move)));
 
       // Check for legality just before making the move
       if (
@@ -1596,7 +1801,7 @@ moves_loop: // When in check, search starts from here
     tte->save(posKey, value_to_tt(bestValue, ss->ply), pvHit,
               bestValue >= beta ? BOUND_LOWER :
               PvNode && bestValue > oldAlpha  ? BOUND_EXACT : BOUND_UPPER,
-              ttDepth, bestMove, ss->staticEval);
+              ttDepth, bestMove, ss->staticEval, thisThread->tt->generation());
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1799,6 +2004,9 @@ void MainThread::check_time() {
   {
       lastInfoTime = tick;
       dbg_print();
+#if defined(ENABLE_SEARCH_STATS)
+      sync_cout << "info string " << SearchStats::summary() << sync_endl;
+#endif
   }
 
   // We should not stop pondering until told so by the GUI
@@ -1812,6 +2020,22 @@ void MainThread::check_time() {
 }
 
 
+/// Thread::check_limits() stops a search of its own, that the main thread does
+/// not control, like the moves of a selfplay game, at its node or time limit.
+
+void Thread::check_limits() {
+
+  if (--limitsCallsCnt > 0)
+      return;
+
+  limitsCallsCnt = nodesLimit ? std::min(1024, static_cast<int>(nodesLimit / 1024)) : 1024;
+
+  if (   nodesLimit && nodes.load(std::memory_order_relaxed) >= nodesLimit
+      || timeLimit && now() >= timeLimit)
+      *stopFlag = true;
+}
+
+
 /// UCI::pv() formats PV information according to the UCI protocol. UCI requires
 /// that all (if any) unsearched PV lines are sent using a previous search score.
 
@@ -2014,16 +2238,10 @@ namespace Learner
       // Clear all history types. This initialization takes a little time, and the accuracy of the search is rather low, so the good and bad are not well understood.
       // th->clear();
 
-      int ct = static_cast<int>(Options["Contempt"]) * PawnValueEg / 100; // From centipawns
 	    const Color us = pos.side_to_move();
 
       // In analysis mode, adjust contempt in accordance with user preference
-      if (Limits.infinite || static_cast<bool>(Options["UCI_AnalyseMode"]))
-        ct = Options["Analysis Contempt"] == "Off" ? 0
-        : Options["Analysis Contempt"] == "Both" ? ct
-        : Options["Analysis Contempt"] == "White" && us == BLACK ? -ct
-        : Options["Analysis Contempt"] == "Black" && us == WHITE ? -ct
-        : ct;
+      const int ct = Conf.contempt_for(us, Limits.infinite || Conf.analyseMode);
 
       // Evaluation score is from the white point of view
       th->contempt = us == WHITE ? make_score(ct, ct / 2)
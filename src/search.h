@@ -88,7 +88,7 @@ struct LimitsType {
   {
 	  // Init explicitly due to broken value-initialization of non POD in MSVC
 	  time[WHITE] = time[BLACK] = inc[WHITE] = inc[BLACK] = npmsec = movetime = static_cast<TimePoint>(0);
-	  movestogo = depth = mate = perft = infinite = 0;
+	  movestogo = depth = mate = perft = perftThreads = infinite = 0;
   }
 
   [[nodiscard]] bool use_time_management() const {
@@ -97,7 +97,7 @@ struct LimitsType {
 
   std::vector<Move> searchmoves;
   TimePoint time[COLOR_NB]{}, inc[COLOR_NB]{}, npmsec, movetime, startTime;
-  int movestogo, depth, mate, perft, infinite;
+  int movestogo, depth, mate, perft, perftThreads, infinite;
   int64_t nodes;
   // Silent mode that does not output to the screen (for continuous self-play in process)
   // Do not output PV at this time.
@@ -0,0 +1,181 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "searchstats.h"
+
+#if defined(ENABLE_SEARCH_STATS)
+
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <vector>
+
+namespace SearchStats {
+
+thread_local ThreadStats Local;
+
+namespace {
+
+  // Snapshot is the sum of the counters of several threads
+  struct Snapshot {
+    uint64_t counters[COUNTER_NB], ttProbes[MAX_PLY], ttHits[MAX_PLY];
+    uint64_t cutoffs[CutoffSlots], time[TIMER_NB];
+  };
+
+  std::mutex mutex;
+  std::vector<ThreadStats*> live;  // Counters of the running threads
+  Snapshot retired;                // Sum of the counters of the exited threads
+
+  template<typename T, int N>
+  void accumulate(uint64_t (&dst)[N], const T (&src)[N]) {
+    for (int i = 0; i < N; ++i)
+        dst[i] += src[i];
+  }
+
+  void accumulate(Snapshot& s, const ThreadStats& ts) {
+    accumulate(s.counters, ts.counters);
+    accumulate(s.ttProbes, ts.ttProbes);
+    accumulate(s.ttHits, ts.ttHits);
+    accumulate(s.cutoffs, ts.cutoffs);
+    accumulate(s.time, ts.time);
+  }
+
+  template<typename T>
+  void reset(T& a) { for (auto& c : a) c = 0; }
+
+  void reset(ThreadStats& ts) {
+    reset(ts.counters); reset(ts.ttProbes); reset(ts.ttHits);
+    reset(ts.cutoffs); reset(ts.time);
+  }
+
+  Snapshot total() {
+
+    std::lock_guard lk(mutex);
+
+    Snapshot s = retired;
+    for (const ThreadStats* ts : live)
+        accumulate(s, *ts);
+    return s;
+  }
+
+  double ratio(const uint64_t a, const uint64_t b) { return b ? double(a) / b : 0; }
+
+} // namespace
+
+
+ThreadStats::ThreadStats() {
+
+  reset(*this);
+
+  std::lock_guard lk(mutex);
+  live.push_back(this);
+}
+
+ThreadStats::~ThreadStats() {
+
+  std::lock_guard lk(mutex);
+  accumulate(retired, *this);
+  live.erase(std::find(live.begin(), live.end(), this));
+}
+
+
+/// SearchStats::clear() resets the counters of all the threads. Should be
+/// called when no search is running.
+
+void clear() {
+
+  std::lock_guard lk(mutex);
+
+  retired = Snapshot();
+  for (ThreadStats* ts : live)
+      reset(*ts);
+}
+
+
+/// SearchStats::summary() returns the main counters on a single line, to be
+/// sent as an 'info string' while searching.
+
+std::string summary() {
+
+  const Snapshot s = total();
+  const uint64_t nodes = s.counters[PV_NODES] + s.counters[NON_PV_NODES] + s.counters[QSEARCH_NODES];
+  uint64_t probes = 0, hits = 0;
+
+  for (int d = 0; d < MAX_PLY; ++d)
+      probes += s.ttProbes[d], hits += s.ttHits[d];
+
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(2)
+     << "stats nodes pv " << s.counters[PV_NODES]
+     << " nonpv " << s.counters[NON_PV_NODES]
+     << " qsearch " << s.counters[QSEARCH_NODES]
+     << " evalspernode " << ratio(s.counters[EVALUATIONS], nodes)
+     << " tthit " << 100 * ratio(hits, probes) << "%"
+     << " firstmovecutoff " << 100 * ratio(s.cutoffs[0], std::accumulate(s.cutoffs, s.cutoffs + CutoffSlots, uint64_t(0))) << "%"
+     << " nnuerefresh " << s.counters[NNUE_REFRESHES]
+     << " nnueupdate " << s.counters[NNUE_UPDATES];
+
+  return ss.str();
+}
+
+
+/// SearchStats::report() returns all the counters, printed after 'bench'
+
+std::string report() {
+
+  const Snapshot s = total();
+  const uint64_t nodes = s.counters[PV_NODES] + s.counters[NON_PV_NODES] + s.counters[QSEARCH_NODES];
+  const uint64_t cutoffs = std::accumulate(s.cutoffs, s.cutoffs + CutoffSlots, uint64_t(0));
+  std::stringstream ss;
+
+  ss << std::fixed << std::setprecision(2)
+     << "\nSearch statistics"
+     << "\n  PV nodes            : " << s.counters[PV_NODES]
+     << "\n  Non-PV nodes        : " << s.counters[NON_PV_NODES]
+     << "\n  Qsearch nodes       : " << s.counters[QSEARCH_NODES]
+     << "\n  Evaluations / node  : " << ratio(s.counters[EVALUATIONS], nodes)
+     << "\n  NNUE refreshes      : " << s.counters[NNUE_REFRESHES]
+     << "\n  NNUE updates        : " << s.counters[NNUE_UPDATES]
+     << "\n  Dirty pieces/update : " << ratio(s.counters[NNUE_DIRTY_PIECES], s.counters[NNUE_UPDATES])
+     << "\n  Movegen time (ms)   : " << s.time[MOVEGEN_TIME] / 1000000
+     << "\n  Movepick time (ms)  : " << s.time[MOVEPICK_TIME] / 1000000
+     << "\n  Eval time (ms)      : " << s.time[EVAL_TIME] / 1000000
+     << "\n\n  TT hit rate by depth";
+
+  for (int d = 0; d < MAX_PLY; ++d)
+      if (s.ttProbes[d])
+          ss << "\n    depth " << std::setw(3) << d << " : " << std::setw(6)
+             << 100 * ratio(s.ttHits[d], s.ttProbes[d]) << "% of " << s.ttProbes[d];
+
+  ss << "\n\n  Beta cutoffs by move count";
+
+  for (int i = 0; i < CutoffSlots; ++i)
+      if (s.cutoffs[i])
+          ss << "\n    move " << std::setw(2) << i + 1 << (i == CutoffSlots - 1 ? "+" : " ")
+             << " : " << std::setw(6) << 100 * ratio(s.cutoffs[i], cutoffs) << "%";
+
+  return ss.str();
+}
+
+} // namespace SearchStats
+
+#endif // defined(ENABLE_SEARCH_STATS)
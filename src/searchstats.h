@@ -0,0 +1,109 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SEARCHSTATS_H_INCLUDED
+#define SEARCHSTATS_H_INCLUDED
+
+/// Search profiling counters, compiled in with "make searchstats=yes", that
+/// defines ENABLE_SEARCH_STATS. Otherwise the STATS_* macros expand to nothing
+/// and have no cost. Each thread updates its own counters, that are summed
+/// when printed: a one line summary every second during a search, and the
+/// full report after 'bench'.
+
+#if defined(ENABLE_SEARCH_STATS)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "types.h"
+
+namespace SearchStats {
+
+enum Counter {
+  PV_NODES, NON_PV_NODES, QSEARCH_NODES, EVALUATIONS,
+  NNUE_REFRESHES, NNUE_UPDATES, NNUE_DIRTY_PIECES,
+  COUNTER_NB
+};
+
+enum Timer { MOVEGEN_TIME, MOVEPICK_TIME, EVAL_TIME, TIMER_NB };
+
+constexpr int CutoffSlots = 32; // Cutoffs by later moves are counted in the last slot
+
+struct ThreadStats {
+
+  ThreadStats();
+ ~ThreadStats();
+
+  std::atomic<uint64_t> counters[COUNTER_NB];
+  std::atomic<uint64_t> ttProbes[MAX_PLY], ttHits[MAX_PLY]; // By depth
+  std::atomic<uint64_t> cutoffs[CutoffSlots];               // By move count
+  std::atomic<uint64_t> time[TIMER_NB];                     // In nanoseconds
+};
+
+extern thread_local ThreadStats Local;
+
+// Only the owner thread writes its counters, so a plain load and store is
+// enough and avoids the cost of an atomic read-modify-write.
+inline void add(std::atomic<uint64_t>& c, const uint64_t v) {
+  c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+// ScopedTimer adds the time spent in its scope to the given timer. Timers are
+// inclusive: movepick time includes the move generation it triggers.
+class ScopedTimer {
+
+  const Timer timer;
+  const std::chrono::steady_clock::time_point start;
+
+public:
+  explicit ScopedTimer(const Timer t) : timer(t), start(std::chrono::steady_clock::now()) {}
+ ~ScopedTimer() {
+    add(Local.time[timer], std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start).count());
+  }
+};
+
+void clear();
+std::string summary();
+std::string report();
+
+} // namespace SearchStats
+
+#define STATS_INC(c)           SearchStats::add(SearchStats::Local.counters[c], 1)
+#define STATS_ADD(c, v)        SearchStats::add(SearchStats::Local.counters[c], (v))
+#define STATS_TT_PROBE(d, hit) do { const int d_ = std::clamp(int(d), 0, MAX_PLY - 1); \
+                                    SearchStats::add(SearchStats::Local.ttProbes[d_], 1); \
+                                    SearchStats::add(SearchStats::Local.ttHits[d_], (hit)); } while (false)
+#define STATS_CUTOFF(n)        SearchStats::add(SearchStats::Local.cutoffs[std::clamp(int(n), 1, SearchStats::CutoffSlots) - 1], 1)
+#define STATS_TIMER(t)         const SearchStats::ScopedTimer statsTimer_(t)
+
+#else
+
+#define STATS_INC(c)
+#define STATS_ADD(c, v)
+#define STATS_TT_PROBE(d, hit)
+#define STATS_CUTOFF(n)
+#define STATS_TIMER(t)
+
+#endif // defined(ENABLE_SEARCH_STATS)
+
+#endif // #ifndef SEARCHSTATS_H_INCLUDED
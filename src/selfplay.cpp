@@ -0,0 +1,395 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if defined(EVAL_NNUE)
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "movegen.h"
+#include "position.h"
+#include "search.h"
+#include "selfplay.h"
+#include "thread.h"
+#include "tt.h"
+#include "uci.h"
+#include "eval/nnue/evaluate_nnue.h"
+
+using Eval::NNUE::Evaluator;
+
+namespace {
+
+  // Elo difference of a score between 0 and 1, and the other way round
+  double elo(double score) {
+    score = Utility::clamp(score, 1e-6, 1 - 1e-6);
+    return -400 * std::log10(1 / score - 1);
+  }
+
+  double score(const double elo) { return 1 / (1 + std::pow(10, -elo / 400)); }
+
+
+  /// Results keeps the results of the match. The games of a pair are played
+  /// one after the other by the same thread, from the same opening, so their
+  /// results are correlated: the statistics use the pentanomial distribution
+  /// of the pair scores, in half points of the first network from 0 to 4.
+
+  struct Results {
+
+    void add(const int halfPoints[2]) {
+      for (int i : { 0, 1 })
+          ++wdl[halfPoints[i]];
+      ++pairs[halfPoints[0] + halfPoints[1]];
+    }
+
+    uint64_t pair_count() const { return pairs[0] + pairs[1] + pairs[2] + pairs[3] + pairs[4]; }
+
+    // Mean score of a game and variance of the mean score of the games of a pair
+    void moments(double& mean, double& variance) const {
+      const double n = double(pair_count());
+      mean = variance = 0;
+      for (int i = 0; i < 5; ++i)
+          mean += i / 4.0 * pairs[i] / n;
+      for (int i = 0; i < 5; ++i)
+          variance += (i / 4.0 - mean) * (i / 4.0 - mean) * pairs[i] / n;
+    }
+
+    // Elo difference and half width of its 95% confidence interval
+    void elo_estimate(double& e, double& margin) const {
+      double mean, variance;
+      moments(mean, variance);
+      const double stdErr = std::sqrt(variance / pair_count());
+      e = elo(mean);
+      margin = (elo(mean + 1.96 * stdErr) - elo(mean - 1.96 * stdErr)) / 2;
+    }
+
+    // Log-likelihood ratio of H1 (elo1) against H0 (elo0), with the normal
+    // approximation of the generalized SPRT.
+    double llr(const double elo0, const double elo1) const {
+      double mean, variance;
+      moments(mean, variance);
+      if (variance <= 0)
+          return 0;
+      const double s0 = score(elo0), s1 = score(elo1);
+      return pair_count() * (s1 - s0) * (2 * mean - s0 - s1) / (2 * variance);
+    }
+
+    uint64_t wdl[3] = {};   // Games lost, drawn and won by the first network
+    uint64_t pairs[5] = {};
+  };
+
+
+  /// Match holds what the threads playing the games share
+
+  struct Match {
+
+    explicit Match(const SelfPlay::Config& c) : config(c) {}
+
+    const SelfPlay::Config& config;
+    std::vector<std::string> openings;
+    std::unique_ptr<Evaluator> nets[2];
+    size_t pairCount = 0;
+    bool chess960 = false;
+    double lowerBound = 0, upperBound = 0; // Of the LLR
+
+    std::atomic<size_t> nextPair = 0;
+    std::atomic_bool stop = false;
+    std::atomic<uint64_t> totalNodes = 0;
+    std::mutex mutex;
+    Results results;
+  };
+
+
+  // think() searches the root position of the thread, with the network and the
+  // TT already set, until one of the limits is reached. Returns the best move
+  // and its score.
+
+  std::pair<Move, Value> think(Thread* th, const SelfPlay::Config& config, const TimePoint budget) {
+
+    Position& pos = th->rootPos;
+
+    // The accumulators of the root, and of its previous position that the root
+    // is updated from, may have been computed by the network of the opponent.
+    for (StateInfo* st : { pos.state(), pos.state()->previous })
+        if (st)
+            st->accumulator.computed_accumulation = st->accumulator.computed_score = false;
+
+    th->rootMoves.clear();
+    for (const auto& m : MoveList<LEGAL>(pos))
+        th->rootMoves.emplace_back(m);
+
+    th->nodes = th->tbHits = th->nmpMinPly = th->bestMoveChanges = 0;
+    th->rootDepth = th->completedDepth = 0;
+    th->nodesLimit = config.nodes;
+    th->timeLimit = budget ? now() + budget : 0;
+    th->limitsCallsCnt = 0;
+    th->groupStop = false;
+
+    th->Thread::search();
+
+    th->nodesLimit = th->timeLimit = 0;
+
+    return { th->rootMoves[0].pv[0], th->rootMoves[0].score };
+  }
+
+
+  // play_game() plays a game from the given opening. Returns the result for the
+  // first network, in half points.
+
+  int play_game(Thread* th, Match& match, TranspositionTable tts[2],
+                const std::string& fen, const int whitePlayer) {
+
+    const SelfPlay::Config& config = match.config;
+    const Value resignValue = Value(config.resignScore * PawnValueEg / 100);
+    StateListPtr states(new std::deque<StateInfo>(1));
+    Position& pos = th->rootPos;
+    TimePoint clock[COLOR_NB] = { config.time, config.time };
+    int agreedPlies = 0;
+    Color agreedWinner = WHITE;
+
+    pos.set(fen, match.chess960, &states->back(), th);
+
+    // Both players start the game without history of the previous one
+    th->clear();
+    for (int i : { 0, 1 })
+        tts[i].clear();
+
+    auto result = [&](const Color winner) { return (winner == WHITE) == (whitePlayer == 0) ? 2 : 0; };
+
+    for (int ply = 0; ; ++ply)
+    {
+        if (!MoveList<LEGAL>(pos).size())
+            return pos.checkers() ? result(~pos.side_to_move()) : 1;
+
+        if (   pos.is_draw(0)
+            || ply >= config.maxPlies
+            || (!pos.pieces(PAWN) && pos.non_pawn_material() <= BishopValueMg))
+            return 1;
+
+        const Color us = pos.side_to_move();
+        const int player = (us == WHITE) == (whitePlayer == 0) ? 0 : 1;
+
+        th->evaluator = match.nets[player].get();
+        th->tt = &tts[player];
+        tts[player].new_search(); // Entries of the previous moves age, as in a game
+
+        const TimePoint budget = config.time ? clock[us] / 20 + config.inc / 2 : config.movetime;
+        const TimePoint startTime = now();
+        const auto [move, value] = think(th, config, budget);
+
+        match.totalNodes += th->nodes;
+
+        if (config.time)
+        {
+            clock[us] -= now() - startTime;
+            if (clock[us] < 0)
+                return result(~us);
+            clock[us] += config.inc;
+        }
+
+        // Adjudicate the game once both sides agree on the winner for long enough
+        if (config.resignScore && abs(value) >= resignValue && abs(value) < VALUE_INFINITE)
+        {
+            const Color winner = value > 0 ? us : ~us;
+            agreedPlies = agreedPlies && winner == agreedWinner ? agreedPlies + 1 : 1;
+            agreedWinner = winner;
+
+            if (agreedPlies >= config.resignPlies)
+                return result(winner);
+        }
+        else
+            agreedPlies = 0;
+
+        states->emplace_back();
+        pos.do_move(move, states->back());
+    }
+  }
+
+
+  // play_pairs() is the loop of each thread: it takes the next game pair until
+  // all of them are played or the SPRT is over, and reports its result.
+
+  void play_pairs(Thread* th, Match& match) {
+
+    const SelfPlay::Config& config = match.config;
+
+    // The tables are allocated by the thread, so that their pages are local to it
+    TranspositionTable tts[2];
+    for (int i : { 0, 1 })
+        tts[i].resize(config.hashMb, true);
+
+    th->stopFlag = &th->groupStop;
+
+    for (size_t idx; !match.stop && (idx = match.nextPair++) < match.pairCount; )
+    {
+        const std::string& fen = match.openings[idx % match.openings.size()];
+        const int halfPoints[] = { play_game(th, match, tts, fen, 0),
+                                   play_game(th, match, tts, fen, 1) };
+
+        std::lock_guard lk(match.mutex);
+
+        Results& r = match.results;
+        r.add(halfPoints);
+
+        double e, margin;
+        r.elo_estimate(e, margin);
+
+        std::stringstream ss;
+        ss << "selfplay games " << 2 * r.pair_count()
+           << " W " << r.wdl[2] << " D " << r.wdl[1] << " L " << r.wdl[0]
+           << " pairs " << r.pairs[0] << " " << r.pairs[1] << " " << r.pairs[2]
+           << " " << r.pairs[3] << " " << r.pairs[4]
+           << std::fixed << std::setprecision(1) << " elo " << e << " +- " << margin;
+
+        if (config.sprt)
+        {
+            const double llr = r.llr(config.elo0, config.elo1);
+            ss << std::setprecision(2) << " llr " << llr
+               << " (" << match.lowerBound << ", " << match.upperBound << ")";
+
+            if (llr <= match.lowerBound || llr >= match.upperBound)
+                match.stop = true;
+        }
+
+        sync_cout << ss.str() << sync_endl;
+    }
+
+    th->evaluator = nullptr;
+    th->tt = &TT;
+    th->stopFlag = &Threads.stop;
+  }
+
+} // namespace
+
+
+namespace SelfPlay {
+
+/// run() loads the two networks, each on its own thread, and plays the match
+/// on all the threads of the pool. The command loop is blocked until the end.
+
+void run(const Config& config) {
+
+  Threads.main()->wait_for_search_finished();
+
+  if (!Conf.evalNNUE)
+  {
+      sync_cout << "info string selfplay needs the NNUE evaluation, set EvalNNUE" << sync_endl;
+      return;
+  }
+
+  Match match(config);
+
+  if (!config.book.empty())
+  {
+      std::ifstream file(config.book);
+      std::string fen;
+
+      if (!file)
+      {
+          sync_cout << "info string Unable to open " << config.book << sync_endl;
+          return;
+      }
+
+      while (std::getline(file, fen))
+          if (fen.find_first_not_of(" \r") != std::string::npos)
+              match.openings.push_back(fen);
+  }
+
+  if (match.openings.empty())
+      match.openings.push_back(StartFEN);
+
+  // Load the networks concurrently. The eval hash is keyed by the hash of the
+  // parameters of each one, so identical networks share their entries.
+  bool loaded[2];
+  std::string files[2];
+
+  for (int i : { 0, 1 })
+  {
+      files[i] = config.nets[i].empty() ? std::string(Options["EvalFile"]) : config.nets[i];
+      Threads[i % Threads.size()]->run_custom_job([&match, &loaded, &files, i] {
+          std::ifstream stream(files[i], std::ios::binary);
+          loaded[i] = Eval::NNUE::ReadParameters(stream, match.nets[i]);
+          if (loaded[i])
+              match.nets[i]->evalHashSalt = match.nets[i]->HashParameters();
+      });
+  }
+
+  for (Thread* th : Threads)
+      th->wait_for_search_finished();
+
+  for (int i : { 0, 1 })
+      if (!loaded[i])
+      {
+          sync_cout << "info string Error! " << files[i] << " not found or wrong format" << sync_endl;
+          return;
+      }
+
+  sync_cout << "info string selfplay " << files[0] << " (" << match.nets[0]->GetName() << ") vs "
+            << files[1] << " (" << match.nets[1]->GetName() << "), "
+            << match.openings.size() << " openings, " << Threads.size() << " threads" << sync_endl;
+
+  match.pairCount = (config.games + 1) / 2;
+  match.chess960 = Options["UCI_Chess960"];
+  match.lowerBound = std::log(config.beta / (1 - config.alpha));
+  match.upperBound = std::log((1 - config.beta) / config.alpha);
+
+  const TimePoint startTime = now();
+
+  Search::Limits = Search::LimitsType();
+  Search::Limits.depth = config.depth;
+  Search::Limits.silent = true;
+  Search::Limits.startTime = startTime;
+  Threads.stop = false;
+  Threads.increaseDepth = true;
+
+  for (Thread* th : Threads)
+      th->run_custom_job([th, &match] { play_pairs(th, match); });
+
+  for (Thread* th : Threads)
+      th->wait_for_search_finished();
+
+  const TimePoint elapsed = now() - startTime + 1; // Ensure positivity to avoid a 'divide by zero'
+  const Results& r = match.results;
+
+  std::stringstream ss;
+  ss << "info string Played " << 2 * r.pair_count() << " games in " << elapsed
+     << "ms, nps " << match.totalNodes * 1000 / elapsed;
+
+  if (config.sprt)
+  {
+      const double llr = r.pair_count() ? r.llr(config.elo0, config.elo1) : 0;
+      ss << ", SPRT [" << config.elo0 << ", " << config.elo1 << "] "
+         << (  llr >= match.upperBound ? "H1 accepted"
+             : llr <= match.lowerBound ? "H0 accepted" : "inconclusive");
+  }
+
+  sync_cout << ss.str() << sync_endl;
+}
+
+} // namespace SelfPlay
+
+#endif // defined(EVAL_NNUE)
@@ -0,0 +1,64 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SELFPLAY_H_INCLUDED
+#define SELFPLAY_H_INCLUDED
+
+#if defined(EVAL_NNUE)
+
+#include <string>
+
+#include "misc.h"
+#include "types.h"
+
+/// The "selfplay" command plays a match between two networks inside the
+/// engine, without the process startup, UCI text I/O and network loading per
+/// game of an external tournament manager. Each thread of the pool plays game
+/// pairs on its own: one opening of the book with each network as white, a
+/// single-threaded search for each move with the network, the private TT and
+/// the limits of the side to move. The score is reported as an Elo difference
+/// with its 95% confidence interval, computed from the game pairs, and with an
+/// optional SPRT that ends the match as soon as one hypothesis is accepted.
+
+namespace SelfPlay {
+
+struct Config {
+  std::string nets[2];  // Network files of the two players, the EvalFile if empty
+  std::string book;     // FEN or EPD lines, the start position if empty
+  size_t games = 100;   // Rounded up to a whole number of game pairs
+  uint64_t nodes = 0;   // Limits of the search of each move, 0 if none
+  Depth depth = 0;
+  TimePoint movetime = 0;
+  TimePoint time = 0, inc = 0; // Clock of each player in ms, lost on time
+  size_t hashMb = 16;   // Transposition table of each player on each thread
+  int maxPlies = 400;   // Longer games are adjudicated as draws
+  int resignScore = 0;  // In centipawns, games are adjudicated when both sides
+  int resignPlies = 8;  // agree on a larger score during so many plies
+  bool sprt = false;
+  double elo0 = 0, elo1 = 5, alpha = 0.05, beta = 0.05;
+};
+
+void run(const Config& config);
+
+} // namespace SelfPlay
+
+#endif // defined(EVAL_NNUE)
+
+#endif // #ifndef SELFPLAY_H_INCLUDED
@@ -19,7 +19,9 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <cstdio>    // For std::rename and std::remove
 #include <cstring>   // For std::memset and std::memcpy
 #include <deque>
 #include <fstream>
@@ -27,18 +29,22 @@
 #include <list>
 #include <sstream>
 #include <type_traits>
+#include <unordered_map>
 #include <mutex>
 
 #include "../bitboard.h"
+#include "../misc.h"
 #include "../movegen.h"
 #include "../position.h"
 #include "../search.h"
+#include "../thread.h"
 #include "../types.h"
 #include "../uci.h"
 
 #include "tbprobe.h"
 
 #ifndef _WIN32
+#include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
@@ -167,38 +173,215 @@ static_assert(sizeof(LR) == 3, "LR tree entry must be 3 bytes");
 //  TBTable:  one object for each file with corresponding indexing information
 //  TBTables: has ownership of TBTable objects, keeping a list and a hash
 
-// class TBFile memory maps/unmaps the single .rtbw and .rtbz files. Files are
-// memory mapped for best performance. Files are mapped at first access: at init
-// time only existence of the file is checked.
-class TBFile final : public std::ifstream {
+// class TBIndex maps the names of the .rtbw and .rtbz files to the directory
+// where they are found, so that at init time tables are discovered without
+// opening any file. Each directory is listed once. When the "SyzygyIndex"
+// option names a sidecar file, the listing is saved there and is reused by the
+// next engine processes as long as the paths and the modification times of the
+// directories are unchanged, so that even the listing of slow network storage
+// is skipped.
+class TBIndex {
 
-    std::string fname;
+    std::unordered_map<std::string, std::string> files;
+    std::vector<std::pair<std::string, int64_t>> dirs; // Directory and its modification time
+
+    static constexpr const char* Magic = "sf-tbindex 2";
+
+    static int64_t modification_time(const std::string& dir) {
+
+#ifndef _WIN32
+        struct stat statbuf;
+        return stat(dir.c_str(), &statbuf) ? -1 : static_cast<int64_t>(statbuf.st_mtime);
+#else
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!GetFileAttributesExA(dir.c_str(), GetFileExInfoStandard, &data))
+            return -1;
+        return int64_t(data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime;
+#endif
+    }
+
+    static std::vector<std::string> list(const std::string& dir) {
+
+        std::vector<std::string> names;
+
+#ifndef _WIN32
+        if (DIR* d = opendir(dir.c_str()))
+        {
+            while (const dirent* e = readdir(d))
+                names.emplace_back(e->d_name);
+
+            closedir(d);
+        }
+#else
+        WIN32_FIND_DATAA data;
+        const HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &data);
+
+        if (h != INVALID_HANDLE_VALUE)
+        {
+            do names.emplace_back(data.cFileName);
+            while (FindNextFileA(h, &data));
+
+            FindClose(h);
+        }
+#endif
+        return names;
+    }
+
+    void add(const std::string& name, const size_t dirIdx) {
+
+        const size_t len = name.size();
+
+        if (len > 5 && (!name.compare(len - 5, 5, ".rtbw") || !name.compare(len - 5, 5, ".rtbz")))
+            files.emplace(name, dirs[dirIdx].first); // The first directory wins
+    }
+
+    bool read(const std::string& sidecar, const std::string& paths) {
+
+        std::ifstream in(sidecar);
+        std::string line, token, name;
+        size_t dirCount = 0, dirIdx, fileCount = 0, count;
+
+        if (   !std::getline(in, line) || line != Magic
+            || !std::getline(in, line) || line != paths)
+            return false;
+
+        while (std::getline(in, line))
+        {
+            std::istringstream ss(line);
+            ss >> token;
+
+            if (token == "dir")
+            {
+                int64_t mtime;
+                ss >> mtime >> std::ws;
+                std::getline(ss, name);
+
+                if (   dirCount >= dirs.size()
+                    || dirs[dirCount].first != name
+                    || dirs[dirCount].second != mtime)
+                    return false;
+
+                dirCount++;
+            }
+            else if (token == "file" && ss >> dirIdx >> name && dirIdx < dirCount)
+            {
+                add(name, dirIdx);
+                fileCount++;
+            }
+            else if (token == "end" && ss >> count)
+                // The file is complete only with this last line
+                return dirCount == dirs.size() && count == fileCount && !std::getline(in, line);
+            else
+                return false;
+        }
+
+        return false;
+    }
+
+    // The sidecar is written to a temporary file that is then renamed, so that
+    // processes starting at the same time never read a partly written one.
+    void write(const std::string& sidecar, const std::string& paths) const {
+
+        const std::string tmp = sidecar + ".tmp" + std::to_string(process_id()) + "-" + std::to_string(now());
+        std::ofstream out(tmp);
+        size_t fileCount = 0;
+
+        out << Magic << "\n" << paths << "\n";
+
+        for (const auto& [dir, mtime] : dirs)
+            out << "dir " << mtime << " " << dir << "\n";
+
+        for (const auto& [name, dir] : files)
+            for (size_t i = 0; i < dirs.size(); ++i)
+                if (dirs[i].first == dir)
+                {
+                    out << "file " << i << " " << name << "\n";
+                    fileCount++;
+                    break;
+                }
+
+        out << "end " << fileCount << "\n";
+        out.close();
+
+#ifdef _WIN32
+        std::remove(sidecar.c_str()); // rename() does not replace an existing file
+#endif
+        if (out.fail() || std::rename(tmp.c_str(), sidecar.c_str()))
+            std::remove(tmp.c_str());
+    }
 
 public:
-    // Look for and open the file among the Paths directories where the .rtbw
-    // and .rtbz files can be found. Multiple directories are separated by ";"
-    // on Windows and by ":" on Unix-based operating systems.
+    // Multiple directories are separated by ";" on Windows and by ":" on
+    // Unix-based operating systems.
     //
     // Example:
     // C:\tb\wdl345;C:\tb\wdl6;D:\tb\dtz345;D:\tb\dtz6
-    static std::string Paths;
-
-    explicit TBFile(const std::string& f) {
+    //
+    // Returns true if the index has been read from the sidecar file.
+    bool build(const std::string& paths, const std::string& sidecar) {
 
 #ifndef _WIN32
         constexpr char SepChar = ':';
 #else
         constexpr char SepChar = ';';
 #endif
-        std::stringstream ss(Paths);
+        files.clear();
+        dirs.clear();
+
+        if (paths.empty() || paths == "<empty>")
+            return false;
+
+        std::stringstream ss(paths);
         std::string path;
 
-        while (std::getline(ss, path, SepChar)) {
-            fname = path + "/" + f;
+        while (std::getline(ss, path, SepChar))
+            dirs.emplace_back(path, modification_time(path));
+
+        const bool useSidecar = !sidecar.empty() && sidecar != "<empty>";
+
+        if (useSidecar && read(sidecar, paths))
+            return true;
+
+        files.clear();
+
+        for (size_t i = 0; i < dirs.size(); ++i)
+            for (const auto& name : list(dirs[i].first))
+                add(name, i);
+
+        if (useSidecar)
+            write(sidecar, paths);
+
+        return false;
+    }
+
+    // Returns the full path of the file, or an empty string if not found
+    [[nodiscard]] std::string find(const std::string& f) const {
+
+        const auto it = files.find(f);
+        return it != files.end() ? it->second + "/" + f : std::string();
+    }
+};
+
+// class TBFile memory maps/unmaps the single .rtbw and .rtbz files. Files are
+// memory mapped for best performance. Files are mapped at first access: at init
+// time only existence of the file is checked, in the directory index.
+class TBFile final : public std::ifstream {
+
+    std::string fname;
+
+public:
+    // Index of the files found among the SyzygyPath directories
+    static TBIndex Index;
+
+    // When set, the kernel is asked to read a file in the background as soon
+    // as it is mapped, so that the first probes do not stall on cold pages.
+    static bool Prefetch;
+
+    // Open the file in the directory where it has been found by the index
+    explicit TBFile(const std::string& f) : fname(Index.find(f)) {
+
+        if (!fname.empty())
             std::ifstream::open(fname);
-            if (is_open())
-                return;
-        }
     }
 
     // Memory map the file and check it. File should be already open and will be
@@ -226,7 +409,6 @@ public:
 
         *mapping = statbuf.st_size;
         *baseAddress = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
-        madvise(*baseAddress, statbuf.st_size, MADV_RANDOM);
         ::close(fd);
 
         if (*baseAddress == MAP_FAILED)
@@ -234,6 +416,11 @@ public:
             std::cerr << "Could not mmap() " << fname << std::endl;
             exit(EXIT_FAILURE);
         }
+
+        madvise(*baseAddress, statbuf.st_size, MADV_RANDOM);
+
+        if (Prefetch)
+            madvise(*baseAddress, statbuf.st_size, MADV_WILLNEED); // Asynchronous readahead
 #else
         // Note FILE_FLAG_RANDOM_ACCESS is only a hint to Windows and as such may get ignored.
         const HANDLE fd = CreateFile(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
@@ -286,7 +473,7 @@ public:
     static void unmap(const void* baseAddress, const uint64_t mapping) {
 
 #ifndef _WIN32
-        munmap(baseAddress, mapping);
+        munmap(const_cast<void*>(baseAddress), mapping);
 #else
         UnmapViewOfFile(baseAddress);
         CloseHandle((HANDLE)mapping);
@@ -294,7 +481,8 @@ public:
     }
 };
 
-std::string TBFile::Paths;
+TBIndex TBFile::Index;
+bool TBFile::Prefetch;
 
 // struct PairsData contains low level indexing information to access TB data.
 // There are 8, 4 or 2 PairsData records for each TBTable, according to type of
@@ -468,6 +656,83 @@ public:
 
 TBTables TBTables;
 
+// class ProbeCache stores the results of probe_wdl() and probe_dtz(), keyed by
+// position key, so that positions probed again by search, rank_root_moves()
+// or gensfen skip the decompression. Entries are written by all the threads
+// without locks: the key is stored xor-ed with the data, so an entry torn by
+// a concurrent write is just a miss. Sized by the "SyzygyCache" option.
+class ProbeCache {
+
+    struct Entry {
+        Key check;
+        uint64_t data;
+    };
+
+    static Key entry_key(const Key key, const TBType type) {
+        return type == WDL ? key : key ^ 0xC3A5C85C97CB3127ULL;
+    }
+
+public:
+   ~ProbeCache() { aligned_large_pages_free(table); }
+
+    void resize(const size_t mbSize) {
+
+        aligned_large_pages_free(table);
+        entryCount = mbSize * 1024 * 1024 / sizeof(Entry);
+        table = entryCount ? static_cast<Entry*>(aligned_large_pages_alloc(entryCount * sizeof(Entry))) : nullptr;
+
+        if (!table)
+            entryCount = 0;
+        else
+            std::memset(table, 0, entryCount * sizeof(Entry));
+    }
+
+    template<TBType Type>
+    bool probe(const Key key, int& value, ProbeState& result) const {
+
+        if (!entryCount)
+            return false;
+
+        const Key k = entry_key(key, Type);
+        const Entry* e = &table[mul_hi64(k, entryCount)];
+        const uint64_t data = e->data;
+
+        if ((e->check ^ data) != k)
+            return false;
+
+        value  = static_cast<int32_t>(static_cast<uint32_t>(data));
+        result = static_cast<ProbeState>(static_cast<int32_t>(data >> 32));
+        return true;
+    }
+
+    template<TBType Type>
+    void save(const Key key, const int value, const ProbeState result) const {
+
+        if (!entryCount)
+            return;
+
+        const Key k = entry_key(key, Type);
+        Entry* e = &table[mul_hi64(k, entryCount)];
+        const uint64_t data =  static_cast<uint64_t>(static_cast<uint32_t>(value))
+                            | static_cast<uint64_t>(static_cast<uint32_t>(result)) << 32;
+        e->check = k ^ data;
+        e->data = data;
+    }
+
+private:
+    Entry* table = nullptr;
+    size_t entryCount = 0;
+};
+
+ProbeCache Cache;
+
+// Probe counters are kept by each thread, like tbHits, and summed when they
+// are reported. Only the owner thread writes them, so a plain load and store
+// avoids both an atomic read-modify-write and a cache line shared by threads.
+inline void add_stat(std::atomic<uint64_t>& c, const uint64_t v) {
+    c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
 // If the corresponding file exists two new objects TBTable<WDL> and TBTable<DTZ>
 // are created and added to the lists and hash table. Called at init time.
 void TBTables::add(const std::vector<PieceType>& pieces) {
@@ -477,13 +742,10 @@ void TBTables::add(const std::vector<PieceType>& pieces) {
     for (const PieceType pt : pieces)
         code += PieceToChar[pt];
 
-    TBFile file(code.insert(code.find('K', 1), "v") + ".rtbw"); // KRK -> KRvK
-
-    if (!file.is_open()) // Only WDL file is checked
+    // Only WDL file is checked, in the index to avoid touching the storage
+    if (TBFile::Index.find(code.insert(code.find('K', 1), "v") + ".rtbw").empty()) // KRK -> KRvK
         return;
 
-    file.close();
-
     MaxCardinality = std::max(static_cast<int>(pieces.size()), MaxCardinality);
 
     wdlTable.emplace_back(code);
@@ -1247,17 +1509,57 @@ WDLScore search(Position& pos, ProbeState* result) {
     return *result = OK, value;
 }
 
+// Look up the position in the probe cache, otherwise run the given probe and
+// store its result. Failed probes are not cached. The time spent in probes
+// missing the cache is accumulated, for the average latency.
+template<TBType Type, typename Probe>
+int cached_probe(const Position& pos, ProbeState* result, Probe probe) {
+
+    int value;
+    Thread* const th = pos.this_thread();
+
+    if (th)
+        add_stat(th->tbProbes, 1);
+
+    if (Cache.probe<Type>(pos.key(), value, *result))
+    {
+        if (th)
+            add_stat(th->tbCacheHits, 1);
+        return value;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    value = probe();
+
+    if (th)
+        add_stat(th->tbMissTime, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now() - start).count());
+
+    if (*result != FAIL)
+        Cache.save<Type>(pos.key(), value, *result);
+
+    return value;
+}
+
+int dtz_probe(Position& pos, ProbeState* result);
+
 } // namespace
 
 
 /// Tablebases::init() is called at startup and after every change to
-/// "SyzygyPath" UCI option to (re)create the various tables. It is not thread
-/// safe, nor it needs to be.
+/// "SyzygyPath", "SyzygyIndex", "SyzygyCache" or "SyzygyPrefetch" UCI options
+/// to (re)create the various tables. Files are only looked up in the directory
+/// index here, they are opened and mapped at first probe by mapped(). It is
+/// not thread safe, nor it needs to be.
 void Tablebases::init(const std::string& paths) {
 
     TBTables.clear();
+    Cache.resize(0);
     MaxCardinality = 0;
-    TBFile::Paths = paths;
+    TBFile::Prefetch = Options["SyzygyPrefetch"];
+
+    const bool fromSidecar = TBFile::Index.build(paths, Options["SyzygyIndex"]);
 
     if (paths.empty() || paths == "<empty>")
         return;
@@ -1394,7 +1696,25 @@ void Tablebases::init(const std::string& paths) {
         }
     }
 
-    sync_cout << "info string Found " << TBTables.size() << " tablebases" << sync_endl;
+    if (TBTables.size())
+        Cache.resize(static_cast<size_t>(Options["SyzygyCache"]));
+
+    sync_cout << "info string Found " << TBTables.size() << " tablebases"
+              << (fromSidecar ? " (index read from sidecar file)" : "") << sync_endl;
+}
+
+
+/// Tablebases::stats() returns the probe counters accumulated since the last
+/// call to Tablebases::reset_stats(), done at the start of every search.
+ProbeStats Tablebases::stats() {
+
+    return { Threads.tb_probes(), Threads.tb_cache_hits(), Threads.tb_miss_time() };
+}
+
+void Tablebases::reset_stats() {
+
+    for (Thread* th : Threads)
+        th->tbProbes = th->tbCacheHits = th->tbMissTime = 0;
 }
 
 // Probe the WDL table for a particular position.
@@ -1407,8 +1727,10 @@ void Tablebases::init(const std::string& paths) {
 //  2 : win
 WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result) {
 
-    *result = OK;
-    return search<false>(pos, result);
+    return static_cast<WDLScore>(cached_probe<WDL>(pos, result, [&] {
+        *result = OK;
+        return static_cast<int>(search<false>(pos, result));
+    }));
 }
 
 // Probe the DTZ table for a particular position.
@@ -1439,6 +1761,15 @@ WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result) {
 // then do not accept moves leading to dtz + 50-move-counter == 100.
 int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
 
+    return cached_probe<DTZ>(pos, result, [&] { return dtz_probe(pos, result); });
+}
+
+namespace {
+
+// The uncached probe_dtz(). Positions of the 1-ply search are probed directly,
+// so that the probe counters match the calls to probe_dtz().
+int dtz_probe(Position& pos, ProbeState* result) {
+
     *result = OK;
     const WDLScore wdl = search<true>(pos, result);
 
@@ -1474,7 +1805,7 @@ int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
         // position after the move to get the score sign (because even in a
         // winning position we could make a losing capture or going for a draw).
         dtz = zeroing ? -dtz_before_zeroing(search<false>(pos, result))
-                      : -probe_dtz(pos, result);
+                      : -dtz_probe(pos, result);
 
         // If the move mates, force minDTZ to 1
         if (dtz == 1 && pos.checkers() && MoveList<LEGAL>(pos).size() == 0)
@@ -1499,6 +1830,8 @@ int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
     return minDTZ == 0xFFFF ? -1 : minDTZ;
 }
 
+} // namespace
+
 
 // Use the DTZ tables to rank root moves.
 //
@@ -44,9 +44,16 @@ enum ProbeState {
     ZEROING_BEST_MOVE =  2  // Best move zeroes DTZ (capture or pawn move)
 };
 
+// Counters of probe_wdl() and probe_dtz() calls, the time is in nanoseconds
+struct ProbeStats {
+    uint64_t probes, cacheHits, missTime;
+};
+
 extern int MaxCardinality;
 
 void init(const std::string& paths);
+ProbeStats stats();
+void reset_stats();
 WDLScore probe_wdl(Position& pos, ProbeState* result);
 int probe_dtz(Position& pos, ProbeState* result);
 bool root_probe(Position& pos, Search::RootMoves& rootMoves);
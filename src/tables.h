@@ -0,0 +1,44 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TABLES_H_INCLUDED
+#define TABLES_H_INCLUDED
+
+#include "types.h"
+
+/// Tables computed once by the "tables" command and linked as read-only data,
+/// instead of being computed at every start of the engine. "make tables"
+/// regenerates tables.cpp, and the "tables" command without a file name checks
+/// the linked tables against freshly computed ones.
+
+namespace Tables {
+
+constexpr unsigned KPKIndexCount = 2 * 24 * 64 * 64; // stm * psq * wksq * bksq, see bitbase.cpp
+
+// Magic numbers of the 64 bit magic index, see init_magics() in bitboard.cpp
+extern const Bitboard RookMagics[SQUARE_NB];
+extern const Bitboard BishopMagics[SQUARE_NB];
+
+// KPK bitbase, bit i of word i / 64 set if position i is a win
+extern const uint64_t KPKBitbase[KPKIndexCount / 64];
+
+} // namespace Tables
+
+#endif // #ifndef TABLES_H_INCLUDED
@@ -19,6 +19,7 @@
 */
 
 #include <cassert>
+#include <sstream>
 
 #include <algorithm> // For std::count
 #include "movegen.h"
@@ -34,7 +35,7 @@ ThreadPool Threads; // Global object
 /// Thread constructor launches the thread and waits until it goes to sleep
 /// in idle_loop(). Note that 'searching' and 'exit' should be already set.
 
-Thread::Thread(const size_t n) : idx(n), stdThread(&Thread::idle_loop, this) {
+Thread::Thread(const size_t n) : idx(n), stdThread(&Thread::idle_loop, this), stopFlag(&Threads.stop) {
 
   wait_for_search_finished();
 }
@@ -93,6 +94,21 @@ void Thread::start_searching() {
 }
 
 
+/// Thread::run_custom_job() wakes up the thread to run the given function
+/// instead of a search. Used for work that must be done by the thread itself,
+/// like first-touching its own memory after it has been bound to a NUMA node.
+
+void Thread::run_custom_job(std::function<void()> f) {
+
+  wait_for_search_finished();
+
+  std::lock_guard lk(mutex);
+  jobFunc = std::move(f);
+  searching = true;
+  cv.notify_one();
+}
+
+
 /// Thread::wait_for_search_finished() blocks on the condition variable
 /// until the thread has finished searching.
 
@@ -108,13 +124,9 @@ void Thread::wait_for_search_finished() {
 
 void Thread::idle_loop() {
 
-  // If OS already scheduled us on a different group than 0 then don't overwrite
-  // the choice, eventually we are one of many one-threaded processes running on
-  // some Windows NUMA hardware, for instance in fishtest. To make it simple,
-  // just check if running threads are below a threshold, in this case all this
-  // NUMA machinery is not needed.
-  if (Options["Threads"] > 8)
-      WinProcGroup::bindThisThread(idx);
+  // Bind the thread according to the "Thread Binding" policy, before it
+  // touches any of its memory.
+  WinProcGroup::bindThisThread(idx);
 
   while (true)
   {
@@ -126,9 +138,15 @@ void Thread::idle_loop() {
       if (exit)
           return;
 
+      const std::function<void()> job = std::move(jobFunc);
+      jobFunc = nullptr;
+
       lk.unlock();
 
-      search();
+      if (job)
+          job();
+      else
+          search();
   }
 }
 
@@ -150,8 +168,19 @@ void ThreadPool::set(const size_t requested) {
 
       while (size() < requested)
           push_back(new Thread(size()));
+
+      // Pawn and material tables are reallocated by their owner thread
+      for (Thread* th : *this)
+          th->run_custom_job([th] {
+              th->pawnsTable.first_touch();
+              th->materialTable.first_touch();
+          });
+
       clear();
 
+      if (const std::string layout = WinProcGroup::layout(requested); !layout.empty())
+          sync_cout << "info string " << layout << sync_endl;
+
       // Reallocate the hash with the new threadpool size
       TT.resize(Options["Hash"]);
 
@@ -161,13 +190,17 @@ void ThreadPool::set(const size_t requested) {
 }
 
 
-/// ThreadPool::clear() sets threadPool data to initial values
+/// ThreadPool::clear() sets threadPool data to initial values. Histories are
+/// reset by each thread itself, so that they are first-touched on its node.
 
 void ThreadPool::clear() const
 {
 
   for (Thread* th : *this)
-      th->clear();
+      th->run_custom_job([th] { th->clear(); });
+
+  for (Thread* th : *this)
+      th->wait_for_search_finished();
 
   main()->callsCnt = 0;
   main()->bestPreviousScore = VALUE_INFINITE;
@@ -194,6 +227,8 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
           || std::count(limits.searchmoves.begin(), limits.searchmoves.end(), m))
           rootMoves.emplace_back(m);
 
+  Tablebases::reset_stats();
+
   if (!rootMoves.empty())
       Tablebases::rank_root_moves(pos, rootMoves);
 
@@ -224,6 +259,142 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   main()->start_searching();
 }
 
+/// ThreadPool::analyse() searches the positions read from 'in', one FEN per
+/// line until EOF or a line "end", to a fixed depth. For bulk analysis many
+/// roots searched independently scale much better than Lazy SMP on a single
+/// root, so the threads are split into groups, each one doing Lazy SMP on its
+/// own root position with its own root moves and stop flag. The TT is shared.
+/// The first thread of a group, its leader, pulls the next position from the
+/// input and a result line is printed as soon as a position is done.
+
+void ThreadPool::analyse(std::istream& in, size_t groupCount, const Depth depth) {
+
+  main()->wait_for_search_finished();
+
+  groupCount = Utility::clamp(groupCount, size_t(1), size());
+
+  const bool chess960 = Options["UCI_Chess960"];
+  const TimePoint startTime = now();
+  std::mutex inputMutex;
+  size_t positionCount = 0;
+  std::atomic<uint64_t> totalNodes(0);
+
+  Search::Limits = Search::LimitsType();
+  Search::Limits.depth = depth;
+  Search::Limits.silent = true;
+  Search::Limits.startTime = startTime;
+  stop = false;
+  increaseDepth = true;
+  TT.new_search();
+
+  // The leader is the first thread of the group, helpers are the others
+  auto lead = [&](const std::vector<Thread*>& group) {
+
+      Thread* leader = group.front();
+      StateInfo st;
+      std::string fen;
+
+      while (true)
+      {
+          size_t posIdx;
+
+          {
+              std::lock_guard lk(inputMutex);
+
+              while (std::getline(in, fen) && fen.find_first_not_of(" \r") == std::string::npos) {}
+
+              if (!in || fen.find("end") == 0)
+                  break;
+
+              posIdx = positionCount++;
+          }
+
+          Search::RootMoves rootMoves;
+          uint64_t nodes = 0;
+
+          leader->rootPos.set(fen, chess960, &st, leader);
+
+          for (const auto& m : MoveList<LEGAL>(leader->rootPos))
+              rootMoves.emplace_back(m);
+
+          if (!rootMoves.empty())
+          {
+              for (Thread* th : group)
+              {
+                  th->nodes = th->tbHits = th->nmpMinPly = th->bestMoveChanges = 0;
+                  th->rootDepth = th->completedDepth = 0;
+                  th->rootMoves = rootMoves;
+                  th->rootPos.set(fen, chess960, &st, th);
+                  th->stopFlag = &leader->groupStop;
+              }
+
+              leader->groupStop = false;
+
+              for (Thread* th : group)
+                  if (th != leader)
+                      th->run_custom_job([th] { th->Thread::search(); });
+
+              leader->Thread::search();
+              leader->groupStop = true;
+
+              for (Thread* th : group)
+              {
+                  if (th != leader)
+                      th->wait_for_search_finished();
+
+                  nodes += th->nodes;
+              }
+
+              totalNodes += nodes;
+          }
+
+          std::stringstream ss;
+          ss << "analysis " << posIdx;
+
+          if (rootMoves.empty())
+              ss << " depth 0 score "
+                 << UCI::value(leader->rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW);
+          else
+          {
+              const Search::RootMove& rm = leader->rootMoves[0];
+
+              ss << " depth " << leader->completedDepth
+                 << " score " << UCI::value(rm.score)
+                 << " nodes " << nodes
+                 << " pv";
+
+              for (const Move m : rm.pv)
+                  ss << " " << UCI::move(m, chess960);
+          }
+
+          sync_cout << ss.str() << sync_endl;
+      }
+  };
+
+  // Split the threads in groups of about the same size, the leader of a group
+  // runs the loop above and starts the helpers of its group itself.
+  std::vector<std::vector<Thread*>> groups(groupCount);
+
+  for (size_t i = 0; i < size(); ++i)
+      groups[i * groupCount / size()].push_back(at(i));
+
+  for (auto& group : groups)
+      group.front()->run_custom_job([&lead, &group] { lead(group); });
+
+  for (Thread* th : *this)
+      th->wait_for_search_finished();
+
+  for (Thread* th : *this)
+      th->stopFlag = &stop;
+
+  const TimePoint elapsed = now() - startTime + 1; // Ensure positivity to avoid a 'divide by zero'
+
+  sync_cout << "info string Analysed " << positionCount << " positions with "
+            << groupCount << " groups in " << elapsed << "ms, nps "
+            << totalNodes * 1000 / elapsed << sync_endl;
+}
+
+
 Thread* ThreadPool::get_best_thread() const {
 
     Thread* bestThread = front();
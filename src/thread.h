@@ -23,6 +23,7 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -33,7 +34,9 @@
 #include "position.h"
 #include "search.h"
 #include "thread_win32_osx.h"
+#include "tt.h"
 
+namespace Eval::NNUE { class Evaluator; }
 
 /// Thread class keeps together all the thread-related stuff. We use
 /// per-thread pawn and material hash tables so that once we get a
@@ -46,6 +49,7 @@ class Thread {
   std::condition_variable cv;
   size_t idx;
   bool exit = false, searching = true; // Set before starting std::thread
+  std::function<void()> jobFunc;
   NativeThread stdThread;
 
 public:
@@ -56,6 +60,8 @@ public:
   void idle_loop();
   void start_searching();
   void wait_for_search_finished();
+  void run_custom_job(std::function<void()> f);
+  void check_limits();
   int best_move_count(Move move) const;
 
   Pawns::Table pawnsTable;
@@ -65,6 +71,12 @@ public:
   int selDepth, nmpMinPly;
   Color nmpColor;
   std::atomic<uint64_t> nodes, tbHits, bestMoveChanges;
+  std::atomic<uint64_t> tbProbes, tbCacheHits, tbMissTime; // See Tablebases::stats()
+  std::atomic_bool* stopFlag; // Threads.stop, or groupStop of the leader of an analysis group
+  std::atomic_bool groupStop;
+  uint64_t nodesLimit = 0; // Limits of a search of its own, like a selfplay move, 0 if none
+  TimePoint timeLimit = 0;
+  int limitsCallsCnt = 0;
 
   Position rootPos;
   Search::RootMoves rootMoves;
@@ -75,6 +87,8 @@ public:
   CapturePieceToHistory captureHistory;
   ContinuationHistory continuationHistory[2][2];
   Score contempt;
+  const Eval::NNUE::Evaluator* evaluator = nullptr; // NNUE network of this thread, nullptr for the loaded one
+  TranspositionTable* tt = &TT; // Transposition table probed by this thread, the global one unless private
 };
 
 
@@ -103,12 +117,16 @@ struct MainThread final : Thread {
 struct ThreadPool : std::vector<Thread*> {
 
   void start_thinking(Position&, StateListPtr&, const Search::LimitsType&, bool = false);
+  void analyse(std::istream& in, size_t groupCount, Depth depth);
   void clear() const;
   void set(size_t);
 
   MainThread* main()        const { return dynamic_cast<MainThread*>(front()); }
   uint64_t nodes_searched() const { return accumulate(&Thread::nodes); }
   uint64_t tb_hits()        const { return accumulate(&Thread::tbHits); }
+  uint64_t tb_probes()      const { return accumulate(&Thread::tbProbes); }
+  uint64_t tb_cache_hits()  const { return accumulate(&Thread::tbCacheHits); }
+  uint64_t tb_miss_time()   const { return accumulate(&Thread::tbMissTime); }
   Thread* get_best_thread() const;
   void start_searching() const;
   void wait_for_search_finished() const;
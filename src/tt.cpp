@@ -18,7 +18,10 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <atomic>
+#include <cstdio>    // For std::rename and std::remove
 #include <cstring>   // For std::memset
+#include <fstream>
 #include <iostream>
 #include <thread>
 
@@ -28,29 +31,103 @@
 #include "tt.h"
 #include "uci.h"
 
+#if defined(EVAL_NNUE)
+#include "eval/nnue/evaluate_nnue.h"
+#endif
+
 TranspositionTable TT; // Our global transposition table
 
+namespace {
+
+/// HashFileHeader is written in front of the clusters by TranspositionTable::save().
+/// Its size is a page, so that the clusters can be mapped directly from the file.
+
+struct HashFileHeader {
+  char     magic[8];
+  uint64_t clusterCount;
+  uint64_t clusterSize;
+  uint64_t netHash;
+  uint8_t  generation8;
+  char     padding[4096 - 8 - 3 * sizeof(uint64_t) - 1];
+};
+
+static_assert(sizeof(HashFileHeader) == 4096, "Unexpected HashFileHeader size");
+
+constexpr char HashFileMagic[8] = "SFHASH1";
+
+/// net_hash() identifies the evaluation the entries were computed with. Hash
+/// files are not loaded if it differs, as stored evals would be wrong.
+
+uint64_t net_hash() {
+
+#if defined(EVAL_NNUE)
+  if (static_cast<bool>(Options["EvalNNUE"]))
+      return Eval::NNUE::parametersHash;
+#endif
+
+  return 0;
+}
+
+} // namespace
+
+
+/// SharedHeader is stored in front of the clusters when the table lives in a
+/// named shared memory segment, see the "Shared Hash" option. Attached
+/// processes share the entries, with the usual lockless save and probe, and
+/// the generation, which is advanced by whichever process starts a search.
+/// The pids of the attached processes are kept, so that those that died
+/// without detaching can be counted out by the next process attaching.
+
+constexpr uint64_t SharedHashMagic = 0x5348415245444832; // "SHAREDH2"
+constexpr uint32_t SharedHashRemoved = UINT32_MAX;       // Set by the last process detaching
+constexpr int SharedHashMaxPids = 512;
+
+template<typename Layout>
+struct alignas(4096) TranspositionTableT<Layout>::SharedHeader {
+  std::atomic<uint64_t> magic;
+  uint64_t              clusterCount;
+  std::atomic<uint32_t> attached;
+  std::atomic<uint8_t>  generation8;
+  std::atomic<int32_t>  pids[SharedHashMaxPids]; // 0 for a free slot
+};
+
+
+/// TranspositionTable::new_search() advances the generation. Lower 3 bits are
+/// used by PV flag and Bound.
+
+template<typename Layout>
+void TranspositionTableT<Layout>::new_search() {
+
+  generation8.store(shared ? shared->generation8 += 8 : static_cast<uint8_t>(generation() + 8),
+                    std::memory_order_relaxed);
+}
+
 /// TTEntry::save() populates the TTEntry with a new node's data, possibly
 /// overwriting an old position. Update is not atomic and can be racy.
 
-void TTEntry::save(const Key k, const Value v, const bool pv, const Bound b, const Depth d, const Move m, const Value ev) {
+template<typename Layout>
+void TTEntryT<Layout>::save(const Key k, const Value v, const bool pv, const Bound b, const Depth d, const Move m,
+                            const Value ev, const uint8_t generation8) {
+
+  const auto key = static_cast<typename Layout::EntryKey>(k);
 
   // Preserve any existing move for the same position
-  if (m || static_cast<uint16_t>(k) != key16)
-      move16 = static_cast<uint16_t>(m);
+  if (m || key != this->key)
+      this->move16 = static_cast<uint16_t>(m);
 
   // Overwrite less valuable entries
-  if (static_cast<uint16_t>(k) != key16
-      || d - DEPTH_OFFSET > depth8 - 4
+  if (key != this->key
+      || d - DEPTH_OFFSET > this->depth8 - 4
       || b == BOUND_EXACT)
   {
       assert(d >= DEPTH_OFFSET);
 
-      key16     = static_cast<uint16_t>(k);
-      value16   = static_cast<int16_t>(v);
-      eval16    = static_cast<int16_t>(ev);
-      genBound8 = static_cast<uint8_t>(TT.generation8 | static_cast<uint8_t>(pv) << 2 | b);
-      depth8    = static_cast<uint8_t>(d - DEPTH_OFFSET);
+      this->key       = key;
+      this->value16   = static_cast<int16_t>(v);
+      if constexpr (Layout::HasEval)
+          this->eval16 = static_cast<int16_t>(ev);
+      this->genBound8 = static_cast<uint8_t>(generation8 | static_cast<uint8_t>(pv) << 2 | b);
+      this->depth8    = static_cast<uint8_t>(d - DEPTH_OFFSET);
   }
 }
 
@@ -58,32 +135,202 @@ void TTEntry::save(const Key k, const Value v, const bool pv, const Bound b, con
 /// TranspositionTable::resize() sets the size of the transposition table,
 /// measured in megabytes. Transposition table consists of a power of 2 number
 /// of clusters and each cluster consists of ClusterSize number of TTEntry.
+/// A private table, used by a single thread or by a benchmark, ignores the
+/// "Shared Hash" option and does not report its allocation.
 
-void TranspositionTable::resize(const size_t mbSize) {
+template<typename Layout>
+void TranspositionTableT<Layout>::resize(const size_t mbSize, const bool isPrivate) {
 
-  Threads.main()->wait_for_search_finished();
+  if (!isPrivate)
+      Threads.main()->wait_for_search_finished();
+
+  // Keep a table of the same size, e.g. one read by loadhash when the thread
+  // pool is resized. It is cleared by the "Clear Hash" button or 'ucinewgame'.
+  if (   !isPrivate && !privateTable && !shared && table
+      && Options["Shared Hash"] == "<empty>"
+      && mbSize * 1024 * 1024 / sizeof(Cluster) == clusterCount)
+      return;
+
+  privateTable = isPrivate;
+
+  if (const std::string name = Options["Shared Hash"]; !privateTable && name != "<empty>")
+  {
+      if (attach(name, mbSize))
+          return;
+
+      sync_cout << "info string Unable to attach to shared hash " << name
+                << ", using a private one" << sync_endl;
+  }
+
+  allocate(mbSize * 1024 * 1024 / sizeof(Cluster));
+
+  clear();
+}
+
+
+/// TranspositionTable::attach() maps the table from the named shared memory
+/// segment, creating it with mbSize megabytes if it does not exist. Otherwise
+/// the size chosen by the creating process is used. A process counts itself
+/// in with the same compare-and-swap that checks the segment is not being
+/// removed by the last process detaching from it, in which case a new one is
+/// created. A segment that cannot be used, e.g. left by a process that crashed
+/// while creating it, is refused: it must be removed by hand (/dev/shm/<name>).
+
+template<typename Layout>
+bool TranspositionTableT<Layout>::attach(const std::string& name, const size_t mbSize) {
 
-  aligned_ttmem_free(mem);
+  release();
 
-  clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
-  table = static_cast<Cluster*>(aligned_ttmem_alloc(clusterCount * sizeof(Cluster), mem));
-  if (!mem)
+  for (int attempt = 0; attempt < 100; ++attempt)
   {
-      std::cerr << "Failed to allocate " << mbSize
+      size_t size = sizeof(SharedHeader) + mbSize * 1024 * 1024 / sizeof(Cluster) * sizeof(Cluster);
+      bool created = false;
+      auto* header = static_cast<SharedHeader*>(map_shared_pages(name, size, created));
+
+      if (!header)
+          return false;
+
+      if (created)
+      {
+          // A new segment is zero filled, publish the header last
+          header->clusterCount = (size - sizeof(SharedHeader)) / sizeof(Cluster);
+          header->attached = 1;
+          header->magic = SharedHashMagic;
+      }
+      else
+      {
+          for (int i = 0; i < 100 && header->magic != SharedHashMagic; ++i)
+              sleep(10);
+
+          if (   header->magic != SharedHashMagic
+              || size != sizeof(SharedHeader) + header->clusterCount * sizeof(Cluster))
+          {
+              aligned_large_pages_free(header);
+              return false;
+          }
+
+          uint32_t n = header->attached;
+          while (n != SharedHashRemoved && !header->attached.compare_exchange_weak(n, n + 1)) {}
+
+          if (n == SharedHashRemoved)
+          {
+              aligned_large_pages_free(header);
+              sleep(10);
+              continue;
+          }
+      }
+
+      // Count out the processes that died attached, we are counted in so the
+      // count does not drop to 0, then record our own pid.
+      for (auto& slot : header->pids)
+          if (int32_t pid = slot; pid && !process_alive(pid) && slot.compare_exchange_strong(pid, 0))
+              --header->attached;
+
+      for (auto& slot : header->pids)
+          if (int32_t pid = 0; slot.compare_exchange_strong(pid, process_id()))
+              break;
+
+      shared = header;
+      sharedName = name;
+      clusterCount = header->clusterCount;
+      table = reinterpret_cast<Cluster*>(header + 1);
+      generation8 = header->generation8.load();
+
+      sync_cout << "info string Hash table " << (created ? "created in" : "attached to")
+                << " shared memory " << name << ", " << clusterCount * sizeof(Cluster) / (1024 * 1024)
+                << "MB, " << header->attached << " process(es)" << sync_endl;
+
+      return true;
+  }
+
+  return false;
+}
+
+
+/// TranspositionTable::release() frees the table. The last process detaching
+/// from a shared table marks it removed, so that no process attaches to it
+/// any more, and removes the segment.
+
+template<typename Layout>
+void TranspositionTableT<Layout>::release() {
+
+  if (shared)
+  {
+      for (auto& slot : shared->pids)
+          if (int32_t pid = process_id(); slot.compare_exchange_strong(pid, 0))
+              break;
+
+      uint32_t n = shared->attached;
+      while (!shared->attached.compare_exchange_weak(n, n == 1 ? SharedHashRemoved : n - 1)) {}
+
+      if (n == 1)
+          unlink_shared_pages(sharedName);
+
+      aligned_large_pages_free(shared);
+      shared = nullptr;
+  }
+  else
+      aligned_large_pages_free(table);
+
+  table = nullptr;
+  mappedFile.clear();
+}
+
+
+/// TranspositionTable::allocate() replaces the table with an uninitialized one
+/// of the given number of clusters.
+
+template<typename Layout>
+void TranspositionTableT<Layout>::allocate(const size_t newClusterCount) {
+
+  static bool firstCall = true;
+  PageKind kind;
+
+  release();
+
+  clusterCount = newClusterCount;
+  table = static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster), &kind));
+  if (!table)
+  {
+      std::cerr << "Failed to allocate " << clusterCount * sizeof(Cluster) / (1024 * 1024)
                 << "MB for transposition table." << std::endl;
       exit(EXIT_FAILURE);
   }
 
-  clear();
+  // Suppress info strings on the first call. The first call occurs before 'uci'
+  // is received and in that case this output confuses some GUIs. Private tables
+  // may be allocated concurrently by their owning threads and stay silent.
+  if (privateTable)
+      return;
+
+  if (!firstCall)
+      sync_cout << "info string Hash table allocation: " << page_kind_string(kind) << sync_endl;
+  firstCall = false;
 }
 
 
 /// TranspositionTable::clear() initializes the entire transposition table to zero,
-//  in a multi-threaded way.
+//  in a multi-threaded way. A shared table is zeroed only when its segment is
+//  created, as other processes may be using it. A private table is zeroed by
+//  the calling thread, so that its pages are local to the thread using them.
 
-void TranspositionTable::clear() const
+template<typename Layout>
+void TranspositionTableT<Layout>::clear() const
 {
 
+  if (shared)
+  {
+      sync_cout << "info string Shared hash " << sharedName
+                << " not cleared, other processes may be using it" << sync_endl;
+      return;
+  }
+
+  if (privateTable)
+  {
+      std::memset(table, 0, clusterCount * sizeof(Cluster));
+      return;
+  }
+
   std::vector<std::thread> threads;
 
   for (size_t idx = 0; idx < static_cast<size_t>(Options["Threads"]); ++idx)
@@ -92,8 +339,7 @@ void TranspositionTable::clear() const
       {
 
           // Thread binding gives faster search on systems with a first-touch policy
-          if (Options["Threads"] > 8)
-              WinProcGroup::bindThisThread(idx);
+          WinProcGroup::bindThisThread(idx);
 
           // Each thread will zero its part of the hash table
           const size_t stride = clusterCount / static_cast<size_t>(Options["Threads"]),
@@ -110,6 +356,203 @@ void TranspositionTable::clear() const
 }
 
 
+/// TranspositionTable::save() writes the table to a file, after a header with
+/// the table geometry, the current generation and the hash of the network.
+/// The file is written under a temporary name and renamed into place, so
+/// that a failed save does not destroy a previous one, nor the pages of a
+/// table mapped from it. A table mapped from the file being replaced is first
+/// copied to memory of its own, as the mapping may not outlive the file.
+
+template<typename Layout>
+bool TranspositionTableT<Layout>::save(const std::string& fname) {
+
+  Threads.main()->wait_for_search_finished();
+
+  if (!mappedFile.empty() && mappedFile == fname)
+  {
+      auto* clusters = static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster)));
+      if (!clusters)
+          return false;
+
+      std::memcpy(clusters, table, clusterCount * sizeof(Cluster));
+      const size_t count = clusterCount;
+      release();
+      table = clusters;
+      clusterCount = count;
+  }
+
+  HashFileHeader header { };
+  std::memcpy(header.magic, HashFileMagic, sizeof(header.magic));
+  header.clusterCount = clusterCount;
+  header.clusterSize  = sizeof(Cluster);
+  header.netHash      = net_hash();
+  header.generation8  = generation();
+
+  const std::string tmp = fname + ".tmp";
+  std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.close();
+
+  if (file.fail() || !transfer(tmp, true, table, clusterCount))
+  {
+      std::remove(tmp.c_str());
+      return false;
+  }
+
+#if defined(_WIN32)
+  std::remove(fname.c_str()); // rename() does not replace an existing file
+#endif
+
+  if (std::rename(tmp.c_str(), fname.c_str()))
+  {
+      std::remove(tmp.c_str());
+      return false;
+  }
+
+  return true;
+}
+
+
+/// TranspositionTable::load() reads a table written by save(). The file is
+/// refused if it was saved with another network. The table takes the size
+/// stored in the file. When 'mapped' is set the table is mapped from the file
+/// instead, where supported, so that pages are read lazily on first access.
+/// On failure the current table and generation are left unchanged.
+
+template<typename Layout>
+bool TranspositionTableT<Layout>::load(const std::string& fname, const bool mapped) {
+
+  Threads.main()->wait_for_search_finished();
+
+  HashFileHeader header;
+  std::ifstream file(fname, std::ios::binary | std::ios::ate);
+  const uint64_t fileSize = file.tellg();
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+  if (   !file
+      || std::memcmp(header.magic, HashFileMagic, sizeof(header.magic))
+      || header.clusterSize != sizeof(Cluster)
+      || fileSize != sizeof(header) + header.clusterCount * sizeof(Cluster))
+  {
+      sync_cout << "info string " << fname << " is not a valid hash file" << sync_endl;
+      return false;
+  }
+
+  if (header.netHash != net_hash())
+  {
+      sync_cout << "info string " << fname << " was saved with another network" << sync_endl;
+      return false;
+  }
+
+  if (shared && (mapped || header.clusterCount != clusterCount))
+  {
+      sync_cout << "info string A shared hash table can only be loaded from a file of the same size, without mmap" << sync_endl;
+      return false;
+  }
+
+  if (mapped)
+  {
+      if (void* mem = map_file_pages(fname, sizeof(header), header.clusterCount * sizeof(Cluster)))
+      {
+          if (header.clusterCount != clusterCount)
+              sync_cout << "info string Hash table size set to "
+                        << header.clusterCount * sizeof(Cluster) / (1024 * 1024) << "MB from " << fname << sync_endl;
+
+          release();
+          table = static_cast<Cluster*>(mem);
+          clusterCount = header.clusterCount;
+          mappedFile = fname;
+          generation8 = header.generation8;
+          return true;
+      }
+
+      sync_cout << "info string Mapping " << fname << " failed, reading it instead" << sync_endl;
+  }
+
+  // Read into a new allocation, so that a short read keeps the current table
+  // and generation instead of leaving a half loaded one.
+  PageKind kind;
+  auto* clusters = static_cast<Cluster*>(aligned_large_pages_alloc(header.clusterCount * sizeof(Cluster), &kind));
+
+  if (!clusters || !transfer(fname, false, clusters, header.clusterCount))
+  {
+      aligned_large_pages_free(clusters);
+      sync_cout << "info string Unable to read " << fname << ", hash table unchanged" << sync_endl;
+      return false;
+  }
+
+  if (shared)
+  {
+      std::memcpy(table, clusters, clusterCount * sizeof(Cluster));
+      aligned_large_pages_free(clusters);
+      shared->generation8 = header.generation8;
+  }
+  else
+  {
+      if (header.clusterCount != clusterCount)
+          sync_cout << "info string Hash table size set to "
+                    << header.clusterCount * sizeof(Cluster) / (1024 * 1024) << "MB from " << fname
+                    << ", allocation: " << page_kind_string(kind) << sync_endl;
+
+      release();
+      table = clusters;
+      clusterCount = header.clusterCount;
+  }
+
+  generation8 = header.generation8;
+  return true;
+}
+
+
+/// TranspositionTable::transfer() writes or reads the given clusters after the
+/// file header, in a multi-threaded way. Each thread streams its own part of
+/// the table with large sequential I/O.
+
+template<typename Layout>
+bool TranspositionTableT<Layout>::transfer(const std::string& fname, const bool write,
+                                           Cluster* const clusters, const size_t count) const {
+
+  static constexpr size_t BlockSize = 64 * 1024 * 1024;
+  const size_t threadCount = static_cast<size_t>(Options["Threads"]);
+  std::atomic<bool> ok(true);
+  std::vector<std::thread> threads;
+
+  for (size_t idx = 0; idx < threadCount; ++idx)
+  {
+      threads.emplace_back([clusters, count, idx, threadCount, write, &fname, &ok]
+      {
+          WinProcGroup::bindThisThread(idx);
+
+          const size_t stride = count / threadCount,
+                       start  = stride * idx,
+                       len    = idx != threadCount - 1 ? stride : count - start;
+
+          std::fstream file(fname, std::ios::binary | std::ios::in | (write ? std::ios::out : std::ios::in));
+          file.seekg(sizeof(HashFileHeader) + start * sizeof(Cluster));
+
+          char* data = reinterpret_cast<char*>(&clusters[start]);
+          for (size_t pos = 0; pos < len * sizeof(Cluster) && file; pos += BlockSize)
+          {
+              const size_t size = std::min(BlockSize, len * sizeof(Cluster) - pos);
+              if (write)
+                  file.write(data + pos, size);
+              else
+                  file.read(data + pos, size);
+          }
+
+          if (!file)
+              ok = false;
+      });
+  }
+
+  for (std::thread& th : threads)
+      th.join();
+
+  return ok;
+}
+
+
 /// TranspositionTable::probe() looks up the current position in the transposition
 /// table. It returns true and a pointer to the TTEntry if the position is found.
 /// Otherwise, it returns false and a pointer to an empty or least valuable TTEntry
@@ -117,31 +560,33 @@ void TranspositionTable::clear() const
 /// minus 8 times its relative age. TTEntry t1 is considered more valuable than
 /// TTEntry t2 if its replace value is greater than that of t2.
 
-TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
+template<typename Layout>
+TTEntryT<Layout>* TranspositionTableT<Layout>::probe(const Key key, bool& found) const {
 #if defined(DISABLE_TT)
   return found = false, first_entry(0);
 #else
 
-  TTEntry* const tte = first_entry(key);
-  const auto key16 = static_cast<uint16_t>(key);  // Use the low 16 bits as key inside the cluster
+  Entry* const tte = first_entry(key);
+  const uint8_t gen = generation();
+  const auto entryKey = static_cast<typename Layout::EntryKey>(key);  // The low bits or the full key, as stored in the entries
 
   for (int i = 0; i < ClusterSize; ++i)
-      if (!tte[i].key16 || tte[i].key16 == key16)
+      if (!tte[i].key || tte[i].key == entryKey)
       {
-          tte[i].genBound8 = static_cast<uint8_t>(generation8 | tte[i].genBound8 & 0x7); // Refresh
+          tte[i].genBound8 = static_cast<uint8_t>(gen | tte[i].genBound8 & 0x7); // Refresh
 
-          return found = static_cast<bool>(tte[i].key16), &tte[i];
+          return found = static_cast<bool>(tte[i].key), &tte[i];
       }
 
   // Find an entry to be replaced according to the replacement strategy
-  TTEntry* replace = tte;
+  Entry* replace = tte;
   for (int i = 1; i < ClusterSize; ++i)
       // Due to our packed storage format for generation and its cyclic
       // nature we add 263 (256 is the modulus plus 7 to keep the unrelated
       // lowest three bits from affecting the result) to calculate the entry
       // age correctly even after generation8 overflows into the next cycle.
-      if (  replace->depth8 - (263 + generation8 - replace->genBound8 & 0xF8)
-          >   tte[i].depth8 - (263 + generation8 -   tte[i].genBound8 & 0xF8))
+      if (  replace->depth8 - (263 + gen - replace->genBound8 & 0xF8)
+          >   tte[i].depth8 - (263 + gen -   tte[i].genBound8 & 0xF8))
           replace = &tte[i];
 
   return found = false, replace;
@@ -152,12 +597,22 @@ TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
 /// TranspositionTable::hashfull() returns an approximation of the hashtable
 /// occupation during a search. The hash is x permill full, as per UCI protocol.
 
-int TranspositionTable::hashfull() const {
+template<typename Layout>
+int TranspositionTableT<Layout>::hashfull() const {
 
+  const uint8_t gen = generation();
   int cnt = 0;
   for (int i = 0; i < 1000; ++i)
       for (const auto& j : table[i].entry)
-	      cnt += (j.genBound8 & 0xF8) == generation8;
+	      cnt += (j.genBound8 & 0xF8) == gen;
 
   return cnt / ClusterSize;
 }
+
+
+template class TranspositionTableT<TTLayout32>;
+template class TranspositionTableT<TTLayout64>;
+template class TranspositionTableT<TTLayout16>;
+template struct TTEntryT<TTLayout32>;
+template struct TTEntryT<TTLayout64>;
+template struct TTEntryT<TTLayout16>;
@@ -21,32 +21,24 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <atomic>
+
 #include "misc.h"
 
-/// TTEntry struct is the 10 bytes transposition table entry, defined as below:
+/// TTEntry is a transposition table entry, defined as below:
 ///
-/// key        16 bit
+/// key        16 or 64 bit
 /// move       16 bit
 /// value      16 bit
-/// eval value 16 bit
+/// eval value 16 bit, not stored by all the cluster layouts
 /// generation  5 bit
 /// pv node     1 bit
 /// bound type  2 bit
 /// depth       8 bit
 
-struct TTEntry {
-	[[nodiscard]] Move  move()  const { return static_cast<Move>(move16); }
-	[[nodiscard]] Value value() const { return static_cast<Value>(value16); }
-	[[nodiscard]] Value eval()  const { return static_cast<Value>(eval16); }
-	[[nodiscard]] Depth depth() const { return static_cast<Depth>(depth8) + DEPTH_OFFSET; }
-	[[nodiscard]] bool is_pv()  const { return static_cast<bool>(genBound8 & 0x4); }
-	[[nodiscard]] Bound bound() const { return static_cast<Bound>(genBound8 & 0x3); }
-  void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev);
-
-private:
-  friend class TranspositionTable;
-
-  uint16_t key16;
+template<typename KeyType, bool StoresEval>
+struct TTEntryData {
+  KeyType  key;
   uint16_t move16;
   int16_t  value16;
   int16_t  eval16;
@@ -54,45 +46,120 @@ private:
   uint8_t  depth8;
 };
 
+template<typename KeyType>
+struct TTEntryData<KeyType, false> {
+  KeyType  key;
+  uint16_t move16;
+  int16_t  value16;
+  uint8_t  genBound8;
+  uint8_t  depth8;
+};
+
+
+/// TTLayout is the geometry of a cluster: the entries, how many of them are
+/// in a cluster and the size of a cluster, which should divide the size of a
+/// cache line for best performance, as the cacheline is prefetched when possible.
+/// The layout of the transposition table is chosen at compile time, see the
+/// 'ttcluster' option of the Makefile.
+
+template<typename KeyType, bool StoresEval, int EntriesPerCluster, size_t ClusterBytes>
+struct TTLayout {
+  using EntryKey = KeyType;
+  static constexpr bool HasEval = StoresEval;
+  static constexpr int ClusterSize = EntriesPerCluster;
+  static constexpr size_t Bytes = ClusterBytes;
+};
+
+using TTLayout32 = TTLayout<uint16_t, true,  3, 32>; // 3 entries of 10 bytes, 16 bit keys
+using TTLayout64 = TTLayout<Key,      true,  4, 64>; // 4 entries of 16 bytes, full keys, for huge tables
+using TTLayout16 = TTLayout<uint16_t, false, 2, 16>; // 2 entries of 8 bytes without eval, for small memory
+
+#if defined(TT_CLUSTER_BYTES) && TT_CLUSTER_BYTES == 64
+using TTDefaultLayout = TTLayout64;
+#elif defined(TT_CLUSTER_BYTES) && TT_CLUSTER_BYTES == 16
+using TTDefaultLayout = TTLayout16;
+#else
+using TTDefaultLayout = TTLayout32;
+#endif
+
+template<typename Layout> class TranspositionTableT;
+
+template<typename Layout>
+struct TTEntryT : private TTEntryData<typename Layout::EntryKey, Layout::HasEval> {
+	[[nodiscard]] Move  move()  const { return static_cast<Move>(this->move16); }
+	[[nodiscard]] Value value() const { return static_cast<Value>(this->value16); }
+	[[nodiscard]] Depth depth() const { return static_cast<Depth>(this->depth8) + DEPTH_OFFSET; }
+	[[nodiscard]] bool is_pv()  const { return static_cast<bool>(this->genBound8 & 0x4); }
+	[[nodiscard]] Bound bound() const { return static_cast<Bound>(this->genBound8 & 0x3); }
+	[[nodiscard]] Value eval()  const {
+    if constexpr (Layout::HasEval)
+        return static_cast<Value>(this->eval16);
+    else
+        return VALUE_NONE;
+  }
+  void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8);
+
+private:
+  friend class TranspositionTableT<Layout>;
+};
+
 
 /// A TranspositionTable is an array of Cluster, of size clusterCount. Each
 /// cluster consists of ClusterSize number of TTEntry. Each non-empty TTEntry
-/// contains information on exactly one position. The size of a Cluster should
-/// divide the size of a cache line for best performance, as the cacheline is
-/// prefetched when possible.
+/// contains information on exactly one position.
 
-class TranspositionTable {
+template<typename Layout>
+class TranspositionTableT {
 
-  static constexpr int ClusterSize = 3;
+  static constexpr int ClusterSize = Layout::ClusterSize;
 
-  struct Cluster {
-    TTEntry entry[ClusterSize];
-    char padding[2]; // Pad to 32 bytes
+  struct alignas(Layout::Bytes) Cluster {
+    TTEntryT<Layout> entry[ClusterSize];
   };
 
-  static_assert(sizeof(Cluster) == 32, "Unexpected Cluster size");
+  static_assert(sizeof(Cluster) == Layout::Bytes, "Unexpected Cluster size");
 
 public:
- ~TranspositionTable() { aligned_ttmem_free(mem); }
-  void new_search() { generation8 += 8; } // Lower 3 bits are used by PV flag and Bound
-  TTEntry* probe(Key key, bool& found) const;
+  using Entry = TTEntryT<Layout>;
+
+ ~TranspositionTableT() { release(); }
+  void new_search();
+  Entry* probe(Key key, bool& found) const;
   [[nodiscard]] int hashfull() const;
-  void resize(size_t mbSize);
+  void resize(size_t mbSize, bool isPrivate = false);
   void clear() const;
+  bool save(const std::string& fname);
+  bool load(const std::string& fname, bool mapped);
+  [[nodiscard]] uint8_t generation() const { return generation8.load(std::memory_order_relaxed); }
+  [[nodiscard]] size_t mb_size() const { return clusterCount * sizeof(Cluster) / (1024 * 1024); }
 
-  [[nodiscard]] TTEntry* first_entry(const Key key) const {
+  [[nodiscard]] Entry* first_entry(const Key key) const {
     return &table[mul_hi64(key, clusterCount)].entry[0];
   }
 
 private:
-  friend struct TTEntry;
-
-  size_t clusterCount;
-  Cluster* table;
-  void* mem;
-  uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
+  struct SharedHeader;
+
+  void allocate(size_t newClusterCount);
+  bool attach(const std::string& name, size_t mbSize);
+  void release();
+  bool transfer(const std::string& fname, bool write, Cluster* clusters, size_t count) const;
+
+  size_t clusterCount = 0;
+  Cluster* table = nullptr;
+  SharedHeader* shared = nullptr; // Not null when the table lives in shared memory
+  std::string sharedName;
+  std::string mappedFile; // Not empty when the table is mapped from a hash file
+  bool privateTable = false;
+
+  // Advanced by new_search() of this table only, read by the threads probing it.
+  // Size must be not bigger than TTEntry::genBound8
+  std::atomic<uint8_t> generation8 {};
 };
 
+using TranspositionTable = TranspositionTableT<TTDefaultLayout>;
+using TTEntry = TranspositionTable::Entry;
+
 extern TranspositionTable TT;
 
 #endif // #ifndef TT_H_INCLUDED
@@ -20,17 +20,24 @@
 
 #include <cassert>
 #include <cmath>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
 
+#include "bitboard.h"
 #include "evaluate.h"
 #include "learn/learn.h"
 #include "movegen.h"
 #include "position.h"
 #include "search.h"
+#include "searchstats.h"
+#include "selfplay.h"
+#include "tables.h"
 #include "thread.h"
 #include "timeman.h"
+#include "tt.h"
 #include "uci.h"
 #include "syzygy/tbprobe.h"
 
@@ -41,6 +48,10 @@
 using namespace std;
 
 extern vector<string> setup_bench(const Position&, istream&);
+extern void bench_tt(istream&);
+#if defined(EVAL_LEARN)
+extern void bench_packed(istream&, bool);
+#endif
 
 // FEN string of the initial position, normal chess
 const char* StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
@@ -55,6 +66,9 @@ namespace Learner
   // Learning from the generated game record
   void learn(Position& pos, istringstream& is);
 
+  // Batch evaluation of FEN lists or packed sfens, optionally on a socket
+  void eval_server(Position& pos, istringstream& is);
+
 #if defined(GENSFEN2019)
   // Automatic generation command of teacher phase under development
   void gen_sfen2019(Position& pos, istringstream& is);
@@ -140,7 +154,7 @@ namespace {
 
   // go() is called when engine receives the "go" UCI command. The function sets
   // the thinking time and other parameters from the input string, then starts
-  // the search.
+  // the search. "go perft <depth> threads <n>" limits a perft to n threads.
 
   void go(Position& pos, istringstream& is, StateListPtr& states) {
 
@@ -165,6 +179,7 @@ namespace {
         else if (token == "movetime")  is >> limits.movetime;
         else if (token == "mate")      is >> limits.mate;
         else if (token == "perft")     is >> limits.perft;
+        else if (token == "threads")   is >> limits.perftThreads;
         else if (token == "infinite")  limits.infinite = 1;
         else if (token == "ponder")    ponderMode = true;
 
@@ -172,6 +187,166 @@ namespace {
   }
 
 
+  // analyse() is called when engine receives the "analyse" command. It searches
+  // a list of positions to a fixed depth, several at once, see ThreadPool::analyse().
+  // Example: "analyse depth 12 groups 8 input positions.fen", without "input"
+  // the FEN lines are read from stdin until a line "end".
+
+  void analyse(istringstream& is) {
+
+    string token, fname;
+    Depth depth = 10;
+    size_t groups = Threads.size();
+
+    while (is >> token)
+        if (token == "depth")       is >> depth;
+        else if (token == "groups") is >> groups;
+        else if (token == "input")  is >> fname;
+
+    if (fname.empty())
+    {
+        Threads.analyse(cin, groups, depth);
+        return;
+    }
+
+    ifstream file(fname);
+
+    if (!file)
+        sync_cout << "info string Unable to open " << fname << sync_endl;
+    else
+        Threads.analyse(file, groups, depth);
+  }
+
+
+#if defined(EVAL_NNUE)
+
+  // selfplay() is called when engine receives the "selfplay" command. It plays
+  // a match between two networks on all the threads, see SelfPlay::run().
+  // Example: "selfplay net1 evalsave/3/nn.bin net2 nn.bin book book.epd
+  // games 2000 nodes 20000 sprt 0 5", a missing network is the EvalFile.
+  // Limits are "nodes", "depth", "movetime" and "tc <base ms> <inc ms>", by
+  // default 10000 nodes.
+
+  void selfplay(istringstream& is) {
+
+    SelfPlay::Config config;
+    string token;
+
+    while (is >> token)
+        if (token == "net1")              is >> config.nets[0];
+        else if (token == "net2")         is >> config.nets[1];
+        else if (token == "book")         is >> config.book;
+        else if (token == "games")        is >> config.games;
+        else if (token == "nodes")        is >> config.nodes;
+        else if (token == "depth")        is >> config.depth;
+        else if (token == "movetime")     is >> config.movetime;
+        else if (token == "tc")           is >> config.time >> config.inc;
+        else if (token == "hash")         is >> config.hashMb;
+        else if (token == "maxplies")     is >> config.maxPlies;
+        else if (token == "resign")       is >> config.resignScore >> config.resignPlies;
+        else if (token == "sprt")
+        {
+            is >> config.elo0 >> config.elo1;
+            config.sprt = true;
+        }
+        else if (token == "alpha")        is >> config.alpha;
+        else if (token == "beta")         is >> config.beta;
+
+    if (!config.nodes && !config.depth && !config.movetime && !config.time)
+        config.nodes = 10000;
+
+    SelfPlay::run(config);
+  }
+
+#endif
+
+  // savehash() and loadhash() are called when engine receives the "savehash"
+  // or "loadhash" command. They keep the transposition table across restarts,
+  // e.g. "loadhash analysis.hash mmap" maps the table from the file.
+
+  void savehash(istringstream& is) {
+
+    string fname;
+    is >> fname;
+
+    if (TT.save(fname))
+        sync_cout << "info string Hash table saved to " << fname << sync_endl;
+    else
+        sync_cout << "info string Unable to save hash table to " << fname << sync_endl;
+  }
+
+  void loadhash(istringstream& is) {
+
+    string fname, token;
+    is >> fname >> token;
+
+    if (TT.load(fname, token == "mmap"))
+    {
+        sync_cout << "info string Hash table loaded from " << fname << sync_endl;
+
+        // The table takes the size of the file, keep the option in step. The
+        // table is not reallocated by the resize, as its size does not change.
+        Options["Hash"] = std::to_string(TT.mb_size());
+    }
+  }
+
+
+  // tables() computes the tables that are precomputed in tables.cpp. With a
+  // file name it writes them as the source of tables.cpp, otherwise it checks
+  // them against the tables linked in the engine.
+
+  void tables(istringstream& is) {
+
+    if (!Is64Bit)
+    {
+        sync_cout << "info string The tables must be computed by a 64 bit build" << sync_endl;
+        return;
+    }
+
+    Bitboard rookMagics[SQUARE_NB], bishopMagics[SQUARE_NB];
+    vector<uint64_t> kpk(Tables::KPKIndexCount / 64);
+
+    Bitboards::find_magics(ROOK, rookMagics);
+    Bitboards::find_magics(BISHOP, bishopMagics);
+    Bitbases::generate(kpk.data());
+
+    string fname;
+    if (!(is >> fname))
+    {
+        const bool ok =   equal(rookMagics, rookMagics + SQUARE_NB, Tables::RookMagics)
+                       && equal(bishopMagics, bishopMagics + SQUARE_NB, Tables::BishopMagics)
+                       && equal(kpk.begin(), kpk.end(), Tables::KPKBitbase);
+
+        sync_cout << "info string Precomputed tables " << (ok ? "match" : "differ, run make tables") << sync_endl;
+        return;
+    }
+
+    ofstream out(fname);
+
+    auto write_array = [&](const char* decl, const uint64_t* v, const size_t n) {
+        out << "const " << decl << " = {";
+        for (size_t i = 0; i < n; ++i)
+            out << (i % 4 ? " " : "\n  ") << "0x" << hex << setfill('0') << setw(16) << v[i] << dec << "ULL,";
+        out << "\n};\n\n";
+    };
+
+    out << "// Generated by the \"tables\" command (make tables), do not edit.\n\n"
+        << "#include \"tables.h\"\n\n"
+        << "namespace Tables {\n\n";
+
+    write_array("Bitboard RookMagics[SQUARE_NB]", rookMagics, SQUARE_NB);
+    write_array("Bitboard BishopMagics[SQUARE_NB]", bishopMagics, SQUARE_NB);
+    write_array("uint64_t KPKBitbase[KPKIndexCount / 64]", kpk.data(), kpk.size());
+
+    out << "} // namespace Tables\n";
+
+    if (out)
+        sync_cout << "info string Tables written to " << fname << sync_endl;
+    else
+        sync_cout << "info string Unable to write tables to " << fname << sync_endl;
+  }
+
+
   // bench() is called when engine receives the "bench" command. Firstly
   // a list of UCI commands is setup according to bench parameters, then
   // it is run one by one printing a summary at the end.
@@ -181,9 +356,31 @@ namespace {
     string token;
     uint64_t nodes = 0, cnt = 1;
 
+    // Cluster layouts of the transposition table and, when learning is
+    // enabled, throughput of evaluate() or qsearch() over a training data file
+    const auto start = args.tellg();
+    if (args >> token && token == "tt")
+    {
+        bench_tt(args);
+        return;
+    }
+#if defined(EVAL_LEARN)
+    if (token == "evalbin" || token == "qsearchbin")
+    {
+        bench_packed(args, token == "qsearchbin");
+        return;
+    }
+#endif
+    args.clear();
+    args.seekg(start);
+
     vector<string> list = setup_bench(pos, args);
     const uint64_t num = count_if(list.begin(), list.end(), [](const string& s) { return s.find("go ") == 0 || s.find("eval") == 0; });
 
+#if defined(ENABLE_SEARCH_STATS)
+    SearchStats::clear();
+#endif
+
     TimePoint elapsed = now();
 
     for (const auto& cmd : list)
@@ -218,6 +415,10 @@ namespace {
 
     dbg_print(); // Just before exiting
 
+#if defined(ENABLE_SEARCH_STATS)
+    cerr << SearchStats::report() << endl;
+#endif
+
     cerr << "\n==========================="
          << "\nTotal time (ms) : " << elapsed
          << "\nNodes searched  : " << nodes
@@ -389,9 +590,14 @@ void UCI::loop(const int argc, char* argv[]) {
       else if (token == "d")        sync_cout << pos << sync_endl;
       else if (token == "eval")     sync_cout << Eval::trace(pos) << sync_endl;
       else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
+      else if (token == "savehash") savehash(is);
+      else if (token == "loadhash") loadhash(is);
+      else if (token == "tables")   tables(is);
+      else if (token == "analyse")  analyse(is);
 #if defined (EVAL_LEARN)
       else if (token == "gensfen") Learner::gen_sfen(pos, is);
       else if (token == "learn") Learner::learn(pos, is);
+      else if (token == "evalserver") Learner::eval_server(pos, is);
 
 #if defined (GENSFEN2019)
 	  // Command to generate teacher phase under development
@@ -404,6 +610,7 @@ void UCI::loop(const int argc, char* argv[]) {
 #endif
 
 #if defined(EVAL_NNUE)
+      else if (token == "selfplay") selfplay(is);
       else if (token == "eval_nnue") sync_cout << "eval_nnue = " << Eval::compute_eval(pos) << sync_endl;
 #endif
 
@@ -24,6 +24,8 @@
 #include <map>
 #include <string>
 
+#include "types.h"
+
 class Position;
 
 namespace UCI {
@@ -65,6 +67,24 @@ private:
   OnChange on_change;
 };
 
+/// Config is a typed copy of the options read on hot paths, like evaluation
+/// or the many short searches of the learner, that should not look them up in
+/// the options map. It is refreshed by the 'on change' action of these options.
+struct Config {
+
+  enum AnalysisContempt { AC_OFF, AC_BOTH, AC_WHITE, AC_BLACK };
+
+  void refresh(OptionsMap&);
+  int contempt_for(Color us, bool analysis) const;
+
+  bool evalNNUE;
+  bool useEvalHash;
+  bool analyseMode;
+  int contempt;        // In centipawns
+  int hybridThreshold; // In internal units, 0 if the hybrid evaluation is disabled
+  AnalysisContempt analysisContempt;
+};
+
 void init(OptionsMap&);
 void loop(int argc, char* argv[]);
 std::string value(Value v);
@@ -79,6 +99,7 @@ extern bool load_eval_finished; // = false;
 } // namespace UCI
 
 extern UCI::OptionsMap Options;
+extern UCI::Config Conf;
 
 // Processing when USI "isready" command is called. At this time, the evaluation function is read.
 // Used when you want to load the evaluation function when "isready" does not come in handler of benchmark command etc.
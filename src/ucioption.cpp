@@ -33,15 +33,20 @@
 using std::string;
 
 UCI::OptionsMap Options; // Global object
+UCI::Config Conf;         // Global object
 
 namespace UCI {
 
 /// 'On change' actions, triggered by an option's value change
 void on_clear_hash(const Option&) { Search::clear(); }
 void on_hash_size(const Option& o) { TT.resize(o); }
+void on_shared_hash(const Option&) { TT.resize(Options["Hash"]); }
 void on_logger(const Option& o) { start_logger(o); }
 void on_threads(const Option& o) { Threads.set(o); }
+void on_thread_binding(const Option&) { Threads.set(Options["Threads"]); }
 void on_tb_path(const Option& o) { Tablebases::init(o); }
+void on_tb_option(const Option&) { Tablebases::init(Options["SyzygyPath"]); }
+void on_config(const Option&) { Conf.refresh(Options); }
 void on_eval_file(const Option& o)
 {
     if (static_cast<bool>(Options["EvalNNUE"]))
@@ -67,11 +72,15 @@ void init(OptionsMap& o) {
   constexpr int MaxHashMB = Is64Bit ? 33554432 : 2048;
 
   o["Debug Log File"]        << Option("", on_logger);
-  o["Contempt"]              << Option(24, -100, 100);
-  o["Analysis Contempt"]     << Option("Both var Off var White var Black var Both", "Both");
+  o["Contempt"]              << Option(24, -100, 100, on_config);
+  o["Analysis Contempt"]     << Option("Both var Off var White var Black var Both", "Both", on_config);
   o["Threads"]               << Option(1, 1, 512, on_threads);
+  o["Thread Binding"]        << Option("Auto var Auto var Compact var Spread var None", "Auto", on_thread_binding);
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
   o["Clear Hash"]            << Option(on_clear_hash);
+  // Name of a POSIX shared memory segment holding a hash table shared by all
+  // the processes using the same name, "<empty>" for a private hash table.
+  o["Shared Hash"]           << Option("<empty>", on_shared_hash);
   o["MultiPV"]               << Option(1, 1, 500);
   o["Skill Level"]           << Option(20, 0, 20);
   o["Move Overhead"]         << Option(10, 0, 5000);
@@ -81,7 +90,7 @@ void init(OptionsMap& o) {
   o["BookMoves"]             << Option(16, 0, 10000);
   o["Ponder"]                << Option(false);
   o["UCI_Chess960"]          << Option(false);
-  o["UCI_AnalyseMode"]       << Option(false);
+  o["UCI_AnalyseMode"]       << Option(false, on_config);
   o["UCI_LimitStrength"]     << Option(false);
   o["UCI_Elo"]               << Option(1350, 1350, 2850);
   o["UCI_ShowWDL"]           << Option(false);
@@ -89,6 +98,9 @@ void init(OptionsMap& o) {
   o["SyzygyPath"]            << Option("<empty>", on_tb_path);
   o["SyzygyProbeDepth"]      << Option(1, 1, 100);
   o["SyzygyProbeLimit"]      << Option(7, 0, 7);
+  o["SyzygyIndex"]           << Option("<empty>", on_tb_option);
+  o["SyzygyCache"]           << Option(16, 0, 4096, on_tb_option);
+  o["SyzygyPrefetch"]        << Option(false, on_tb_option);
   // Evaluation function file name. When this is changed, it is necessary to reread the evaluation function at the next ucinewgame timing.
   // Without the preceding "./", some GUIs can not load he net file.
   o["EvalFile"]              << Option("./eval/nn.bin", on_eval_file);
@@ -104,8 +116,45 @@ void init(OptionsMap& o) {
   // Therefore, with this hidden option, you can suppress the loading of the evaluation function when ucinewgame,
   // Hit the test eval convert command.
   o["SkipLoadingEval"]       << Option(false);
-  o["EvalNNUE"]              << Option(true);
-  o["UseEvalHash"]           << Option(false);  
+  o["EvalNNUE"]              << Option(true, on_config);
+  o["UseEvalHash"]           << Option(false, on_config);
+  // Material imbalance in centipawns above which the classical evaluation is
+  // used instead of NNUE, as it is also in known endgames. 0 disables it.
+  o["HybridThreshold"]       << Option(0, 0, 10000, on_config);
+
+  Conf.refresh(o);
+}
+
+
+/// Config::refresh() copies the current values of the options kept in Config
+
+void Config::refresh(OptionsMap& o) {
+
+  evalNNUE         = static_cast<bool>(o["EvalNNUE"]);
+  useEvalHash      = static_cast<bool>(o["UseEvalHash"]);
+  analyseMode      = static_cast<bool>(o["UCI_AnalyseMode"]);
+  contempt         = static_cast<int>(o["Contempt"]);
+  hybridThreshold  = static_cast<int>(o["HybridThreshold"]) * PawnValueMg / 100;
+  analysisContempt =  o["Analysis Contempt"] == "Off"   ? AC_OFF
+                    : o["Analysis Contempt"] == "White" ? AC_WHITE
+                    : o["Analysis Contempt"] == "Black" ? AC_BLACK : AC_BOTH;
+}
+
+
+/// Config::contempt_for() returns the contempt of the side to move, in internal
+/// units. In analysis mode it is adjusted in accordance with user preference.
+
+int Config::contempt_for(const Color us, const bool analysis) const {
+
+  const int ct = contempt * PawnValueEg / 100; // From centipawns
+
+  if (!analysis)
+      return ct;
+
+  return  analysisContempt == AC_OFF                    ? 0
+        : analysisContempt == AC_WHITE && us == BLACK ? -ct
+        : analysisContempt == AC_BLACK && us == WHITE ? -ct
+                                                       : ct;
 }
 
 